@@ -0,0 +1,351 @@
+#include "frame_pipeline.hpp"
+#include "renderer.hpp"
+#include "scenes.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct BenchOptions
+{
+    std::string obj_path = "obj/head.obj";
+    std::string output;
+    int32_t frames = 60;
+    int32_t warmup = 5;
+    std::vector<std::pair<int32_t, int32_t>> resolutions = { {640, 360}, {1280, 720}, {1920, 1080} };
+    std::vector<uint32_t> thread_counts = { 1, 0 };
+    std::vector<std::string> scenes = { "head", "crowd", "cubes", "field", "overdraw", "tiny", "textured", "lights" };
+    std::vector<DepthFormat> depth_formats = { DepthFormat::Float32, DepthFormat::Unorm24, DepthFormat::Unorm16 };
+    std::vector<uint32_t> sample_counts = { 1 };
+    // Simulated upload and vsync wait per presented frame.
+    double present_ms = 0.0;
+    // 0 renders and presents in series, otherwise frames render ahead through a FramePipeline.
+    uint32_t frames_in_flight = 0;
+    bool visibility_buffer = false;
+};
+
+
+// Sorted copy percentile, nearest rank.
+static double percentile(std::vector<double> values, double fraction)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(fraction * static_cast<double>(values.size() - 1) + 0.5);
+    return values[std::min(rank, values.size() - 1)];
+}
+
+
+static double mean(const std::vector<double> &values)
+{
+    double total = 0.0;
+    for (double value : values)
+        total += value;
+    return values.empty() ? 0.0 : total / static_cast<double>(values.size());
+}
+
+
+static void write_distribution(std::ostream &out, const char *name, const std::vector<double> &values)
+{
+    out << "\"" << name << "\": {\"p50\": " << percentile(values, 0.5) << ", \"p99\": " << percentile(values, 0.99) << ", \"mean\": " << mean(values) << "}";
+}
+
+
+struct StageSamples
+{
+    std::vector<double> frame;
+    std::vector<double> clear;
+    std::vector<double> transform;
+    std::vector<double> setup;
+    std::vector<double> geometry;
+    std::vector<double> raster;
+    std::vector<double> resolve;
+    std::vector<double> present;
+};
+
+
+// Pixels whose color differs from a render with float depth, z-fighting and wrongly resolved overlaps.
+static uint64_t count_depth_mismatches(Scene &scene, const Camera &camera, const uint8_t *pixels, int32_t width, int32_t height, uint32_t threads, bool visibility_buffer, uint32_t samples)
+{
+    Renderer reference(width, height, threads, DepthFormat::Float32);
+    reference.set_visibility_buffer(visibility_buffer);
+    reference.set_sample_count(samples);
+    reference.clear(sf::Color::Black);
+    reference.render_scene(scene, camera);
+
+    const uint32_t *expected = reinterpret_cast<const uint32_t *>(reference.get_pixels());
+    const uint32_t *actual = reinterpret_cast<const uint32_t *>(pixels);
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+    {
+        mismatches += expected[i] != actual[i] ? 1 : 0;
+    }
+    return mismatches;
+}
+
+
+static void run_case(std::ostream &out, const BenchOptions &options, const std::string &scene_name, int32_t width, int32_t height, uint32_t threads, DepthFormat depth_format, uint32_t sample_count)
+{
+    std::string source = scene_name == "head" ? options.obj_path : scene_name;
+    Scene scene = scene_name == "crowd" ? create_obj_crowd_scene(options.obj_path) : create_scene_by_name(source);
+
+    Renderer renderer(width, height, threads, depth_format);
+    renderer.set_visibility_buffer(options.visibility_buffer);
+    renderer.set_sample_count(sample_count);
+    Camera camera {glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f};
+
+    // Stands in for the texture upload of the interactive app.
+    std::vector<uint8_t> present_buffer(static_cast<size_t>(width) * height * 4);
+    auto present = [&](const uint8_t *pixels)
+    {
+        std::memcpy(present_buffer.data(), pixels, present_buffer.size());
+        if (options.present_ms > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(options.present_ms));
+    };
+
+    // Stage samples are taken on the thread that renders, right after each frame, and skip the warmup frames.
+    StageSamples samples;
+    PrimitiveStats stats;
+    int32_t rendered = 0;
+    auto render_frame = [&]
+    {
+        renderer.clear(sf::Color::Black);
+        renderer.render_scene(scene, camera);
+
+        if (rendered++ < options.warmup)
+            return;
+        FrameTimings timings = renderer.get_frame_timings();
+        samples.clear.push_back(timings.clear_ms);
+        samples.transform.push_back(timings.transform_ms);
+        samples.setup.push_back(timings.setup_ms);
+        samples.geometry.push_back(timings.geometry_ms);
+        samples.raster.push_back(timings.raster_ms);
+        samples.resolve.push_back(timings.resolve_ms);
+        stats = renderer.get_primitive_stats();
+    };
+
+    // Frame times are the intervals between presented frames, so with a pipeline they measure sustained throughput.
+    if (options.frames_in_flight == 0)
+    {
+        for (int32_t i = 0; i < options.warmup + options.frames; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            render_frame();
+
+            auto present_start = std::chrono::steady_clock::now();
+            present(renderer.get_pixels());
+            auto end = std::chrono::steady_clock::now();
+
+            if (i < options.warmup)
+                continue;
+            samples.frame.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            samples.present.push_back(std::chrono::duration<double, std::milli>(end - present_start).count());
+        }
+    }
+    else
+    {
+        FramePipeline pipeline(renderer, options.frames_in_flight, render_frame);
+        auto previous = std::chrono::steady_clock::now();
+        for (int32_t i = 0; i < options.warmup + options.frames; i++)
+        {
+            const uint8_t *pixels = pipeline.acquire_frame();
+
+            auto present_start = std::chrono::steady_clock::now();
+            present(pixels);
+            auto end = std::chrono::steady_clock::now();
+
+            if (i >= options.warmup)
+            {
+                samples.frame.push_back(std::chrono::duration<double, std::milli>(end - previous).count());
+                samples.present.push_back(std::chrono::duration<double, std::milli>(end - present_start).count());
+            }
+            previous = end;
+        }
+    }
+    // The renderer holds the last finished frame in both modes.
+    uint64_t mismatches = depth_format == DepthFormat::Float32 ? 0 : count_depth_mismatches(scene, camera, renderer.get_pixels(), width, height, threads, options.visibility_buffer, sample_count);
+
+    // Every frame of a case draws the same thing, so the counts of the last one stand for all of them.
+    double seconds = mean(samples.frame) / 1000.0;
+    double pixels = static_cast<double>(width) * height;
+
+    out << "    {\"scene\": \"" << scene_name << "\", \"width\": " << width << ", \"height\": " << height;
+    out << ", \"threads\": " << renderer.get_thread_count() << ", \"kernels\": \"" << renderer.get_span_kernels_name() << "\", \"frames\": " << samples.frame.size() << ",\n";
+    out << "     \"depth_format\": \"" << get_depth_format_name(depth_format) << "\", \"depth_bytes\": " << get_depth_format_size(depth_format) << ", \"samples\": " << sample_count;
+    out << ", \"depth_mismatch_pixels\": " << mismatches << ", \"depth_mismatch_ratio\": " << static_cast<double>(mismatches) / pixels << ",\n";
+    out << "     \"visibility_buffer\": " << (options.visibility_buffer ? "true" : "false") << ", \"frames_in_flight\": " << options.frames_in_flight << ", \"present_ms\": " << options.present_ms << ", \"fps\": " << (seconds > 0.0 ? 1.0 / seconds : 0.0) << ",\n";
+    out << "     \"instances\": " << stats.instances << ", \"instances_reduced_lod\": " << stats.instances_reduced_lod << ",\n";
+    out << "     \"meshlets\": " << stats.meshlets << ", \"meshlets_culled\": " << stats.meshlets_frustum_culled + stats.meshlets_backface_culled << ", \"triangles\": " << stats.submitted << ", \"rasterized\": " << stats.rasterized << ", \"fragments\": " << stats.fragments << ", \"shaded\": " << stats.shaded << ", \"resolved\": " << stats.resolved << ",\n";
+    out << "     \"lights\": " << stats.lights << ", \"lit_tiles\": " << stats.lit_tiles << ", \"tile_lights\": " << stats.tile_lights << ",\n";
+    out << "     \"triangles_per_sec\": " << (seconds > 0.0 ? stats.submitted / seconds : 0.0);
+    out << ", \"pixels_per_sec\": " << (seconds > 0.0 ? pixels / seconds : 0.0);
+    out << ", \"fragments_per_sec\": " << (seconds > 0.0 ? stats.fragments / seconds : 0.0) << ",\n";
+    out << "     ";
+    write_distribution(out, "frame_ms", samples.frame);
+    out << ",\n     \"stages_ms\": {";
+    write_distribution(out, "clear", samples.clear);
+    out << ", ";
+    write_distribution(out, "transform", samples.transform);
+    out << ", ";
+    write_distribution(out, "setup", samples.setup);
+    out << ", ";
+    write_distribution(out, "geometry", samples.geometry);
+    out << ", ";
+    write_distribution(out, "raster", samples.raster);
+    out << ", ";
+    write_distribution(out, "resolve", samples.resolve);
+    out << ", ";
+    write_distribution(out, "present", samples.present);
+    out << "}}";
+}
+
+
+static std::vector<std::string> split(const std::string &text, char separator)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator))
+    {
+        if (!part.empty())
+            parts.push_back(part);
+    }
+    return parts;
+}
+
+
+static void print_usage()
+{
+    std::cout << "usage: rasterizer_bench [--obj <file.obj>] [--frames N] [--warmup N] [--resolutions WxH,...] [--threads N,...] [--scenes head,crowd,cubes,field,overdraw,tiny,textured,lights] [--depth-formats float,unorm24,unorm16] [--samples 1,4,8] [--present-ms X] [--frames-in-flight N] [--visibility-buffer] [--output <file.json>]\n";
+    std::cout << "       --threads 0 uses every hardware thread, transform and setup stage times are summed over threads.\n";
+    std::cout << "       Reduced depth formats report the pixels that differ from a float depth render as depth_mismatch_pixels.\n";
+    std::cout << "       --visibility-buffer renders every case through the visibility buffer, the resolve stage is its shading pass.\n";
+    std::cout << "       --samples lists the multisample counts to run, the present stage includes their resolve.\n";
+    std::cout << "       --present-ms simulates the upload and vsync wait, --frames-in-flight N > 0 renders ahead of presentation.\n";
+}
+
+
+int main(int argc, char **argv)
+{
+    BenchOptions options;
+
+    try
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+
+            if (arg == "--obj" && has_value)
+                options.obj_path = argv[++i];
+            else if (arg == "--frames" && has_value)
+                options.frames = std::stoi(argv[++i]);
+            else if (arg == "--warmup" && has_value)
+                options.warmup = std::stoi(argv[++i]);
+            else if (arg == "--output" && has_value)
+                options.output = argv[++i];
+            else if (arg == "--depth-formats" && has_value)
+            {
+                options.depth_formats.clear();
+                for (const std::string &format : split(argv[++i], ','))
+                    options.depth_formats.push_back(parse_depth_format(format));
+            }
+            else if (arg == "--samples" && has_value)
+            {
+                options.sample_counts.clear();
+                for (const std::string &count : split(argv[++i], ','))
+                    options.sample_counts.push_back(static_cast<uint32_t>(std::stoul(count)));
+            }
+            else if (arg == "--present-ms" && has_value)
+                options.present_ms = std::stod(argv[++i]);
+            else if (arg == "--frames-in-flight" && has_value)
+                options.frames_in_flight = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--visibility-buffer")
+                options.visibility_buffer = true;
+            else if (arg == "--scenes" && has_value)
+                options.scenes = split(argv[++i], ',');
+            else if (arg == "--threads" && has_value)
+            {
+                options.thread_counts.clear();
+                for (const std::string &count : split(argv[++i], ','))
+                    options.thread_counts.push_back(static_cast<uint32_t>(std::stoul(count)));
+            }
+            else if (arg == "--resolutions" && has_value)
+            {
+                options.resolutions.clear();
+                for (const std::string &resolution : split(argv[++i], ','))
+                {
+                    size_t separator = resolution.find('x');
+                    if (separator == std::string::npos)
+                        throw std::runtime_error("Invalid resolution: " + resolution);
+                    options.resolutions.emplace_back(std::stoi(resolution.substr(0, separator)), std::stoi(resolution.substr(separator + 1)));
+                }
+            }
+            else
+            {
+                print_usage();
+                return 1;
+            }
+        }
+
+        // head.obj lives outside the build tree, runs from elsewhere skip it instead of failing.
+        if (!std::filesystem::exists(options.obj_path))
+        {
+            std::cerr << "skipping head and crowd: " << options.obj_path << " not found\n";
+            options.scenes.erase(std::remove(options.scenes.begin(), options.scenes.end(), "head"), options.scenes.end());
+            options.scenes.erase(std::remove(options.scenes.begin(), options.scenes.end(), "crowd"), options.scenes.end());
+        }
+
+        std::ostringstream out;
+        out << "{\n  \"results\": [\n";
+        bool first = true;
+        for (const std::string &scene : options.scenes)
+        {
+            for (const auto &[width, height] : options.resolutions)
+            {
+                for (uint32_t threads : options.thread_counts)
+                {
+                    for (DepthFormat depth_format : options.depth_formats)
+                    {
+                        for (uint32_t samples : options.sample_counts)
+                        {
+                            if (!first)
+                                out << ",\n";
+                            first = false;
+
+                            std::cerr << scene << " " << width << "x" << height << " threads " << threads << " depth " << get_depth_format_name(depth_format) << " samples " << samples << "\n";
+                            run_case(out, options, scene, width, height, threads, depth_format, samples);
+                        }
+                    }
+                }
+            }
+        }
+        out << "\n  ]\n}\n";
+
+        if (options.output.empty())
+        {
+            std::cout << out.str();
+        }
+        else
+        {
+            std::ofstream file(options.output);
+            if (!file)
+                throw std::runtime_error("Failed to open " + options.output);
+            file << out.str();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
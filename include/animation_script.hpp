@@ -0,0 +1,61 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+
+// Camera of one frame of a path, position, rotate and angle as in Camera.
+struct CameraKey
+{
+    uint32_t frame;
+    glm::vec3 position;
+    glm::vec3 rotate;
+    float angle;
+};
+
+
+// How camera and scene move over an offline image sequence. Scripts are text files with one statement per line,
+// # starts a comment:
+//   frames N                         length of the sequence
+//   camera F x y z angle [ax ay az]  camera position at frame F, turned by angle degrees about the axis, y if omitted
+//   turntable degrees [cx cy cz]     the scene turns about the vertical axis through c, the center of its bounds if omitted
+struct AnimationScript
+{
+    uint32_t frame_count = 1;
+    // Sorted by frame. The camera moves linearly between keys and holds before the first and after the last one,
+    // without any it stays at the default view. Between keys with different axes the axis of the earlier one is used.
+    std::vector<CameraKey> camera_keys;
+    // Turn over the whole sequence, the last frame stops one step short of it so that a full turn loops.
+    // Lights stay where they are, like camera and lights around a real turntable.
+    float turntable_degrees = 0.0f;
+    bool turntable_around_bounds = true;
+    glm::vec3 turntable_center = glm::vec3(0.0f);
+};
+
+
+AnimationScript load_animation_script(const std::filesystem::path &path);
+
+// frame_count frames of one full turn of the scene in front of the default camera.
+AnimationScript create_turntable_script(uint32_t frame_count);
+
+Camera get_script_camera(const AnimationScript &script, uint32_t frame);
+
+
+// Poses the instances of a scene for frames of a script, from the transforms they had when it was created.
+class SceneAnimator
+{
+public:
+    SceneAnimator(const AnimationScript &_script, Scene &_scene);
+
+    void apply(uint32_t frame);
+
+private:
+    const AnimationScript &script;
+    Scene &scene;
+    std::vector<ModelTransform> base_transforms;
+    glm::vec3 center;
+};
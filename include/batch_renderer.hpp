@@ -0,0 +1,86 @@
+#pragma once
+
+#include "animation_script.hpp"
+#include "renderer.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+struct BatchStats
+{
+    uint32_t frames = 0;
+    double wall_seconds = 0.0;
+    // Summed over workers and writers. Stalls are the times workers waited for a writer to free a buffer.
+    double render_seconds = 0.0;
+    double stall_seconds = 0.0;
+    double write_seconds = 0.0;
+};
+
+
+// Renders the frames of an image sequence in parallel, each worker with a renderer and a scene of its own, and hands
+// them to writer threads so that encoding and disk never hold up rendering while a buffer is free.
+// Levels of detail are chosen without hysteresis, so a frame comes out the same whichever worker renders it.
+class BatchRenderer
+{
+public:
+    // worker_count == 0 uses every hardware thread divided by threads_per_worker. writer_count == 0 uses one writer per
+    // four workers. create_scene is called once per worker, the first time on the calling thread and then in parallel.
+    BatchRenderer(int32_t width, int32_t height, uint32_t worker_count, uint32_t threads_per_worker, uint32_t _writer_count, DepthFormat depth_format, const std::function<void(Renderer &)> &configure, const std::function<Scene()> &create_scene);
+
+    BatchRenderer(const BatchRenderer &) = delete;
+    BatchRenderer &operator=(const BatchRenderer &) = delete;
+
+    uint32_t get_worker_count() const { return static_cast<uint32_t>(workers.size()); }
+    uint32_t get_writer_count() const { return writer_count; }
+    const Renderer &get_renderer() const { return workers.front()->renderer; }
+
+    // Runs of # in output_pattern are replaced by the zero padded frame number, without any "_####" goes before the
+    // extension. With an empty pattern frames are rendered and dropped. The first exception of any thread is rethrown.
+    BatchStats run(const AnimationScript &script, const std::string &output_pattern);
+
+private:
+    struct Worker
+    {
+        Renderer renderer;
+        Scene scene;
+        double render_seconds = 0.0;
+        double stall_seconds = 0.0;
+
+        Worker(int32_t width, int32_t height, uint32_t thread_count, DepthFormat depth_format) : renderer(width, height, thread_count, depth_format) {}
+    };
+
+    struct OutputFrame
+    {
+        uint32_t frame;
+        ColorBuffer buffer;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    uint32_t writer_count;
+
+    std::mutex mutex;
+    std::condition_variable ready_condition;
+    std::condition_variable free_condition;
+    std::vector<ColorBuffer> free_buffers;
+    std::deque<OutputFrame> ready_frames;
+    uint32_t active_workers = 0;
+    // Also read without the lock, by workers between frames.
+    std::atomic<bool> failed {false};
+    std::exception_ptr error;
+
+    std::atomic<uint32_t> next_frame {0};
+    uint32_t chunk_size = 1;
+
+    void render_loop(Worker &worker, const AnimationScript &script, bool write);
+    void write_loop(const std::string &output_pattern, double &write_seconds);
+    void fail(std::exception_ptr exception);
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+
+struct Aabb
+{
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    bool is_empty() const { return min.x > max.x; }
+    glm::vec3 get_center() const { return (min + max) * 0.5f; }
+    glm::vec3 get_extent() const { return (max - min) * 0.5f; }
+
+    void expand(const glm::vec3 &point) { min = glm::min(min, point); max = glm::max(max, point); }
+    void expand(const Aabb &other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+};
+
+
+struct BoundingSphere
+{
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
+
+
+enum class FrustumTest
+{
+    Outside,
+    Intersecting,
+    Inside
+};
+
+
+// Planes with the normal pointing inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0.
+// There is no far plane, the depth buffer stores 1/w and reaches 0 only at infinity.
+struct Frustum
+{
+    static constexpr uint32_t PLANE_COUNT = 5;
+    static constexpr uint32_t ALL_PLANES = (1 << PLANE_COUNT) - 1;
+
+    std::array<glm::vec4, PLANE_COUNT> planes;
+};
+
+
+Aabb compute_bounds(const std::vector<glm::vec3> &points);
+BoundingSphere compute_bounding_sphere(const std::vector<glm::vec3> &points, const Aabb &bounds);
+
+Aabb transform_bounds(const Aabb &bounds, const glm::mat4 &matrix);
+BoundingSphere transform_bounding_sphere(const BoundingSphere &sphere, const glm::mat4 &matrix);
+
+// Planes of the clip volume -w <= x, y <= w, w >= near_w in the space view_projection maps from.
+Frustum extract_frustum(const glm::mat4 &view_projection, float near_w);
+
+// plane_mask selects the planes to test, the planes bounds is fully inside of are cleared from it.
+FrustumTest test_frustum(const Frustum &frustum, const Aabb &bounds, uint32_t &plane_mask);
+
+// Scales the planes to unit length normals, which sphere tests need.
+void normalize_frustum(Frustum &frustum);
+// False if sphere lies entirely outside one plane of a normalized frustum.
+bool intersects_frustum(const Frustum &frustum, const BoundingSphere &sphere);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "bounds.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+// Bounding volume hierarchy over a list of boxes, the leaves reference boxes by their index.
+class Bvh
+{
+public:
+    // Builds the tree from scratch, splitting at the centroid median along the longest axis.
+    void build(const std::vector<Aabb> &bounds);
+
+    // Recomputes node bounds bottom up and keeps the topology, for boxes that moved but were not added or removed.
+    void refit(const std::vector<Aabb> &bounds);
+
+    // Appends the indices of the boxes that are at least partially inside the frustum, unordered.
+    void cull(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+
+    size_t get_node_count() const { return nodes.size(); }
+
+private:
+    static constexpr uint32_t MAX_LEAF_SIZE = 4;
+
+    // Every node covers indices[first, first + count), inner nodes have their children at left and left + 1.
+    struct Node
+    {
+        Aabb bounds;
+        uint32_t first;
+        uint32_t count;
+        uint32_t left;
+
+        bool is_leaf() const { return left == 0; }
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> indices;
+    // Box of indices[i], so leaves can test their boxes without an indirection.
+    std::vector<Aabb> leaf_bounds;
+
+    void build_node(uint32_t node, const std::vector<Aabb> &bounds);
+};
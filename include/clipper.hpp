@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Vertex in clip space, w is the view space depth. s and t are the weights of vertices 1 and 2 of the unclipped
+// triangle, its other attributes are interpolated with them after clipping.
+struct ClipVertex
+{
+    float x;
+    float y;
+    float w;
+    float s;
+    float t;
+};
+
+
+// One bit per plane a vertex is outside of. The viewport planes are only used for trivial rejects,
+// triangles are clipped against the near plane and the guard band, the rasterizer scissors the rest.
+enum ClipCode : uint16_t
+{
+    CLIP_LEFT = 1 << 0,
+    CLIP_RIGHT = 1 << 1,
+    CLIP_BOTTOM = 1 << 2,
+    CLIP_TOP = 1 << 3,
+    CLIP_NEAR = 1 << 4,
+    CLIP_GUARD_LEFT = 1 << 5,
+    CLIP_GUARD_RIGHT = 1 << 6,
+    CLIP_GUARD_BOTTOM = 1 << 7,
+    CLIP_GUARD_TOP = 1 << 8,
+
+    CLIP_NEEDS_CLIPPING = CLIP_NEAR | CLIP_GUARD_LEFT | CLIP_GUARD_RIGHT | CLIP_GUARD_BOTTOM | CLIP_GUARD_TOP
+};
+
+
+// near_w is the smallest w that is drawn, the guard band spans [-guard, guard] in NDC.
+struct ClipPlanes
+{
+    float near_w;
+    float guard_x;
+    float guard_y;
+};
+
+
+// Each clip plane adds at most one vertex to the triangle.
+static constexpr uint32_t MAX_CLIP_VERTICES = 3 + 5;
+
+
+inline uint16_t compute_clip_code(float x, float y, float w, const ClipPlanes &planes)
+{
+    uint16_t code = 0;
+    code |= x < -w ? CLIP_LEFT : 0;
+    code |= x > w ? CLIP_RIGHT : 0;
+    code |= y < -w ? CLIP_BOTTOM : 0;
+    code |= y > w ? CLIP_TOP : 0;
+    code |= w < planes.near_w ? CLIP_NEAR : 0;
+    code |= x < -planes.guard_x * w ? CLIP_GUARD_LEFT : 0;
+    code |= x > planes.guard_x * w ? CLIP_GUARD_RIGHT : 0;
+    code |= y < -planes.guard_y * w ? CLIP_GUARD_BOTTOM : 0;
+    code |= y > planes.guard_y * w ? CLIP_GUARD_TOP : 0;
+    return code;
+}
+
+
+// Clips the triangle against the planes in clip_codes that need clipping and writes the convex
+// polygon that is left to polygon. Returns its vertex count, less than 3 when nothing is left.
+uint32_t clip_triangle(const ClipVertex *triangle, uint16_t clip_codes, const ClipPlanes &planes, ClipVertex *polygon);
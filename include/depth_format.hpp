@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Closest view space depth that is drawn. Depth is 1/w, so 1 / NEAR_W is the largest value a fragment can have.
+constexpr float NEAR_W = 0.1f;
+
+
+// Every format stores 1/w or a scaled copy of it: larger is closer and the buffer clears to 0, which is
+// reversed Z with the far plane at infinity. Fragments pass when the stored value is smaller than theirs.
+enum class DepthFormat
+{
+    Float32,
+    Unorm24,
+    Unorm16
+};
+
+constexpr size_t DEPTH_FORMAT_COUNT = 3;
+
+
+// Storage type and encoding of each format, the depth test code is instantiated per format.
+struct DepthFloat32
+{
+    using Storage = float;
+
+    static Storage encode(float depth) { return depth; }
+    static float decode(Storage stored) { return stored; }
+};
+
+
+// NEAR_W / w in BITS bits, rounded to nearest. Unorm24 keeps the 32-bit layout of a D24 buffer without the stencil.
+template <typename StorageType, uint32_t BITS>
+struct DepthUnorm
+{
+    using Storage = StorageType;
+
+    static constexpr float MAX_VALUE = static_cast<float>((1u << BITS) - 1);
+    static constexpr float SCALE = NEAR_W * MAX_VALUE;
+
+    // Clamped, interpolation may overshoot the near plane slightly. The SIMD kernels repeat these steps in this order.
+    static Storage encode(float depth) { return static_cast<Storage>(std::min(std::max(depth * SCALE, 0.0f), MAX_VALUE) + 0.5f); }
+    static float decode(Storage stored) { return static_cast<float>(stored) / SCALE; }
+};
+
+using DepthUnorm24 = DepthUnorm<uint32_t, 24>;
+using DepthUnorm16 = DepthUnorm<uint16_t, 16>;
+
+
+// Calls function with a default constructed traits struct of format.
+template <typename Function>
+auto dispatch_depth_format(DepthFormat format, Function &&function)
+{
+    switch (format)
+    {
+    case DepthFormat::Unorm24:
+        return function(DepthUnorm24 {});
+    case DepthFormat::Unorm16:
+        return function(DepthUnorm16 {});
+    default:
+        return function(DepthFloat32 {});
+    }
+}
+
+
+// float, unorm24 or unorm16.
+DepthFormat parse_depth_format(const std::string &name);
+const char *get_depth_format_name(DepthFormat format);
+size_t get_depth_format_size(DepthFormat format);
+
+// Depth as the format stores it, converted to float. Comparing in these units is exact, which the depth pyramid relies on.
+float encode_depth_units(DepthFormat format, float depth);
+
+// Converts count stored values back to 1/w.
+void decode_depth(DepthFormat format, const void *depth, size_t count, float *result);
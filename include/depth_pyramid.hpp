@@ -0,0 +1,47 @@
+#pragma once
+
+#include "depth_format.hpp"
+
+#include <cstdint>
+#include <memory>
+
+
+// Two level hierarchical depth buffer: the farthest stored depth of every 8x8 block and of every tile.
+// Depth is 1/w, larger values are closer, so the farthest depth of a region is its minimum. Values are in the
+// units of the depth format, see encode_depth_units, so tests against them match the depth test exactly.
+class DepthPyramid
+{
+public:
+    static constexpr int32_t BLOCK_SIZE = 8;
+
+    // tile_size must be a multiple of BLOCK_SIZE.
+    DepthPyramid(int32_t width, int32_t height, int32_t tile_size, DepthFormat format);
+
+    // Matches a depth buffer cleared to 0.
+    void clear();
+
+    // Recomputes the blocks that overlap the inclusive pixel rect from depth, then the tile they lie in.
+    // The rect must not cross a tile border, so tiles can be updated from different threads.
+    void update(const void *depth, int32_t min_x, int32_t min_y, int32_t max_x, int32_t max_y);
+
+    // True when no pixel in the inclusive rect can pass a depth test against nearest_depth.
+    bool is_occluded(int32_t min_x, int32_t min_y, int32_t max_x, int32_t max_y, float nearest_depth) const;
+
+private:
+    const int32_t WIDTH;
+    const int32_t HEIGHT;
+    const int32_t TILE_SIZE;
+    const int32_t TILE_BLOCKS;
+    const DepthFormat FORMAT;
+
+    int32_t blocks_x;
+    int32_t blocks_y;
+    int32_t tiles_x;
+    int32_t tiles_y;
+
+    std::unique_ptr<float[]> block_depth;
+    std::unique_ptr<float[]> tile_depth;
+
+    template <typename Format>
+    float compute_block_depth(const typename Format::Storage *depth, int32_t block_x, int32_t block_y) const;
+};
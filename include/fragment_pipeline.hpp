@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+// Varyings are plain structs of floats, glm vectors included, interpolated component by component. A shader is a
+// functor that takes the interpolated Varyings of a pixel and returns its packed color, see pack_color. Shaders that
+// declare USES_DERIVATIVES true also get the screen space derivatives of the varyings along x and y.
+template <typename Varyings>
+struct VaryingLayout
+{
+    static_assert(std::is_trivially_copyable_v<Varyings> && sizeof(Varyings) % sizeof(float) == 0, "Varyings must consist of floats");
+
+    static constexpr uint32_t COUNT = sizeof(Varyings) / sizeof(float);
+};
+
+
+template <typename Shader, typename = void>
+struct ShaderUsesDerivatives : std::false_type
+{
+};
+
+template <typename Shader>
+struct ShaderUsesDerivatives<Shader, std::void_t<decltype(Shader::USES_DERIVATIVES)>> : std::bool_constant<Shader::USES_DERIVATIVES>
+{
+};
+
+
+// Screen space planes of each varying divided by w, relative to vertex 0. Divided by the 1/w plane of the depth
+// buffer they give the perspective correct varying.
+template <typename Varyings>
+struct VaryingPlanes
+{
+    static constexpr uint32_t COUNT = VaryingLayout<Varyings>::COUNT;
+
+    double base[COUNT];
+    double dx[COUNT];
+    double dy[COUNT];
+};
+
+
+// a and b are the edge function coefficients of the triangle and inv_area scales them to attribute gradients per pixel,
+// see Renderer::setup_triangle. inv_w and vertices are in the order the triangle was submitted in, flipped when setup
+// swapped vertices 1 and 2.
+template <typename Varyings>
+void setup_varying_planes(const int64_t *a, const int64_t *b, double inv_area, bool flipped, const float *inv_w, const Varyings *vertices, VaryingPlanes<Varyings> &planes)
+{
+    constexpr uint32_t COUNT = VaryingLayout<Varyings>::COUNT;
+
+    float components[3][COUNT];
+    int32_t order[3] = { 0, flipped ? 2 : 1, flipped ? 1 : 2 };
+    for (int32_t i = 0; i < 3; i++)
+    {
+        std::memcpy(components[i], &vertices[order[i]], sizeof(Varyings));
+    }
+
+    for (uint32_t c = 0; c < COUNT; c++)
+    {
+        double v0 = static_cast<double>(components[0][c]) * inv_w[order[0]];
+        double v1 = static_cast<double>(components[1][c]) * inv_w[order[1]];
+        double v2 = static_cast<double>(components[2][c]) * inv_w[order[2]];
+        planes.base[c] = v0;
+        planes.dx[c] = (a[0] * v0 + a[1] * v1 + a[2] * v2) * inv_area;
+        planes.dy[c] = (b[0] * v0 + b[1] * v1 + b[2] * v2) * inv_area;
+    }
+}
+
+
+// 1/w and varyings / w at the first pixel of a span and their steps per pixel along x and y.
+template <typename Varyings>
+struct VaryingSpan
+{
+    static constexpr uint32_t COUNT = VaryingLayout<Varyings>::COUNT;
+
+    float depth;
+    float depth_dx;
+    float depth_dy;
+    float start[COUNT];
+    float dx[COUNT];
+    float dy[COUNT];
+};
+
+
+// Span of a triangle whose first pixel is offset_x, offset_y pixels from vertex 0, with depth, depth_dx and depth_dy
+// the 1/w plane.
+template <typename Varyings>
+void setup_varying_span(const VaryingPlanes<Varyings> &planes, double depth, double depth_dx, double depth_dy, double offset_x, double offset_y, VaryingSpan<Varyings> &span)
+{
+    constexpr uint32_t COUNT = VaryingLayout<Varyings>::COUNT;
+
+    span.depth = static_cast<float>(depth + depth_dx * offset_x + depth_dy * offset_y);
+    span.depth_dx = static_cast<float>(depth_dx);
+    span.depth_dy = static_cast<float>(depth_dy);
+    for (uint32_t c = 0; c < COUNT; c++)
+    {
+        span.start[c] = static_cast<float>(planes.base[c] + planes.dx[c] * offset_x + planes.dy[c] * offset_y);
+        span.dx[c] = static_cast<float>(planes.dx[c]);
+        span.dy[c] = static_cast<float>(planes.dy[c]);
+    }
+}
+
+
+// Color of the pixel t steps into span, whose 1/w is inv_w.
+template <typename Varyings, typename Shader>
+uint32_t shade_pixel(const VaryingSpan<Varyings> &span, float t, float inv_w, const Shader &shader)
+{
+    constexpr uint32_t COUNT = VaryingLayout<Varyings>::COUNT;
+
+    float w = 1.0f / inv_w;
+    float components[COUNT];
+    for (uint32_t c = 0; c < COUNT; c++)
+    {
+        components[c] = (span.start[c] + span.dx[c] * t) * w;
+    }
+
+    Varyings varyings;
+    std::memcpy(&varyings, components, sizeof(Varyings));
+    if constexpr (ShaderUsesDerivatives<Shader>::value)
+    {
+        // dv = (d(v / w) - v * d(1 / w)) * w
+        float components_dx[COUNT];
+        float components_dy[COUNT];
+        for (uint32_t c = 0; c < COUNT; c++)
+        {
+            components_dx[c] = (span.dx[c] - components[c] * span.depth_dx) * w;
+            components_dy[c] = (span.dy[c] - components[c] * span.depth_dy) * w;
+        }
+
+        Varyings ddx;
+        Varyings ddy;
+        std::memcpy(&ddx, components_dx, sizeof(Varyings));
+        std::memcpy(&ddy, components_dy, sizeof(Varyings));
+        return shader(varyings, ddx, ddy);
+    }
+    else
+    {
+        return shader(varyings);
+    }
+}
+
+
+// Depth test and write of one span like the flat span kernels, with every written pixel colored by shader.
+// Returns the number of pixels written.
+template <typename Format, typename Varyings, typename Shader>
+int32_t shade_span(uint32_t *pixels, void *depth_buffer, int32_t count, const VaryingSpan<Varyings> &span, const Shader &shader)
+{
+    auto *depth = static_cast<typename Format::Storage *>(depth_buffer);
+
+    int32_t written = 0;
+    for (int32_t i = 0; i < count; i++)
+    {
+        float t = static_cast<float>(i);
+        float inv_w = span.depth + span.depth_dx * t;
+        auto value = Format::encode(inv_w);
+        if (depth[i] < value)
+        {
+            pixels[i] = shade_pixel(span, t, inv_w, shader);
+            depth[i] = value;
+            written++;
+        }
+    }
+    return written;
+}
+
+
+// Colors every pixel of a span whose visibility is already resolved, without touching depth.
+template <typename Varyings, typename Shader>
+void shade_visible_span(uint32_t *pixels, int32_t count, const VaryingSpan<Varyings> &span, const Shader &shader)
+{
+    for (int32_t i = 0; i < count; i++)
+    {
+        float t = static_cast<float>(i);
+        pixels[i] = shade_pixel(span, t, span.depth + span.depth_dx * t, shader);
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "renderer.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Renders frames on its own thread into a bounded queue of color buffers while the caller presents earlier ones.
+// The renderer belongs to the render thread while the pipeline exists, render_frame must not race with the caller.
+class FramePipeline
+{
+public:
+    // frames_in_flight is the latency budget: how many finished frames may wait for presentation, at least 1.
+    FramePipeline(Renderer &_renderer, uint32_t frames_in_flight, std::function<void()> _render_frame);
+    ~FramePipeline();
+
+    FramePipeline(const FramePipeline &) = delete;
+    FramePipeline &operator=(const FramePipeline &) = delete;
+
+    // Blocks until the next frame is finished. The pixels stay valid until the next call.
+    // An exception thrown by render_frame is rethrown here.
+    const uint8_t *acquire_frame();
+
+    // Holds the render thread between frames, when neither it nor the renderer's pool record profiler events, so
+    // that the caller can export them. Finished frames stay queued, resume lets rendering continue.
+    void pause();
+    void resume();
+
+private:
+    Renderer &renderer;
+    const uint32_t FRAMES_IN_FLIGHT;
+    std::function<void()> render_frame;
+
+    std::mutex mutex;
+    std::condition_variable ready_condition;
+    std::condition_variable free_condition;
+    std::condition_variable parked_condition;
+    std::vector<ColorBuffer> free_buffers;
+    std::deque<ColorBuffer> ready_buffers;
+    ColorBuffer presented;
+    bool stopping = false;
+    bool pause_requested = false;
+    // The render thread waits for a free buffer or for resume, with its frame finished.
+    bool parked = false;
+    std::exception_ptr error;
+
+    std::thread render_thread;
+
+    void render_loop();
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+
+// Writes an RGBA8 buffer. ".ppm" is written directly as binary P6, any other extension goes through sf::Image.
+void save_color_buffer(const std::filesystem::path &path, const uint8_t *pixels, int32_t width, int32_t height);
+
+// Writes the 1/z depth buffer as a grayscale image normalized to the covered depth range, nearer is brighter.
+void save_depth_buffer(const std::filesystem::path &path, const float *depth_buffer, int32_t width, int32_t height);
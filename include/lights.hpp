@@ -0,0 +1,107 @@
+#pragma once
+
+#include "span_kernels.hpp"
+#include "texture.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+
+// Point light with a finite reach, its contribution falls to zero at radius.
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+    // Linear RGB, 1 lights a white surface facing the light fully at zero distance.
+    glm::vec3 color;
+};
+
+
+// A point light in view space, the form the shader reads.
+struct ViewLight
+{
+    glm::vec3 position;
+    float radius_squared;
+    glm::vec3 color;
+    float inv_radius_squared;
+};
+
+
+// Per pixel view space position and normal of a lit triangle, uv for its texture if it has one.
+struct LitVaryings
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+
+
+// Lambert diffuse and Blinn-Phong specular from the lights of the tile being drawn, plus an ambient term.
+struct LitShader
+{
+    static constexpr bool USES_DERIVATIVES = true;
+    static constexpr float SPECULAR_STRENGTH = 0.4f;
+
+    // Material color in [0, 1], multiplied by the texture if there is one.
+    glm::vec3 albedo;
+    const Texture *texture;
+    glm::vec3 ambient;
+    // Set per tile to the lights that can reach it.
+    const ViewLight *lights = nullptr;
+    uint32_t light_count = 0;
+
+    uint32_t operator()(const LitVaryings &varyings, const LitVaryings &ddx, const LitVaryings &ddy) const
+    {
+        glm::vec3 color = albedo;
+        if (texture)
+        {
+            uint32_t texel = texture->sample(varyings.uv, ddx.uv, ddy.uv);
+            color = color * glm::vec3(static_cast<float>(texel & 0xff), static_cast<float>((texel >> 8) & 0xff), static_cast<float>((texel >> 16) & 0xff)) * (1.0f / 255.0f);
+        }
+
+        float normal_length_squared = glm::dot(varyings.normal, varyings.normal);
+        float position_length_squared = glm::dot(varyings.position, varyings.position);
+        glm::vec3 diffuse = ambient;
+        glm::vec3 specular(0.0f);
+        if (normal_length_squared > 0.0f && position_length_squared > 0.0f)
+        {
+            glm::vec3 normal = varyings.normal * (1.0f / std::sqrt(normal_length_squared));
+            glm::vec3 to_viewer = varyings.position * (-1.0f / std::sqrt(position_length_squared));
+
+            for (uint32_t i = 0; i < light_count; i++)
+            {
+                const ViewLight &light = lights[i];
+                glm::vec3 to_light = light.position - varyings.position;
+                float distance_squared = glm::dot(to_light, to_light);
+                float facing = glm::dot(normal, to_light);
+                if (distance_squared >= light.radius_squared || facing <= 0.0f)
+                    continue;
+
+                float inv_distance = 1.0f / std::sqrt(distance_squared);
+                float falloff = 1.0f - distance_squared * light.inv_radius_squared;
+                falloff *= falloff;
+                diffuse += light.color * (facing * inv_distance * falloff);
+
+                // The power of 32 as five squarings. Below a cosine of 0.1 it is negligible and would reach denormals,
+                // which are many times slower than the rest of the light.
+                glm::vec3 half = to_light * inv_distance + to_viewer;
+                float half_length_squared = glm::dot(half, half);
+                float highlight = glm::dot(normal, half);
+                if (highlight <= 0.1f * std::sqrt(half_length_squared))
+                    continue;
+                highlight /= std::sqrt(half_length_squared);
+                for (int32_t j = 0; j < 5; j++)
+                {
+                    highlight *= highlight;
+                }
+                specular += light.color * (highlight * falloff);
+            }
+        }
+
+        glm::vec3 result = glm::min(color * diffuse + specular * SPECULAR_STRENGTH, glm::vec3(1.0f)) * 255.0f + 0.5f;
+        return pack_color(sf::Color(static_cast<uint8_t>(result.x), static_cast<uint8_t>(result.y), static_cast<uint8_t>(result.z)));
+    }
+};
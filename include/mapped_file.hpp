@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+// Read-only memory mapping of a whole file. Throws std::runtime_error if the file can't be opened or mapped.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return mapped_data; }
+    size_t size() const { return mapped_size; }
+    std::string_view view() const { return std::string_view(mapped_data, mapped_size); }
+
+private:
+    const char *mapped_data = nullptr;
+    size_t mapped_size = 0;
+
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#else
+    int file_descriptor = -1;
+#endif
+};
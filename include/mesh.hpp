@@ -0,0 +1,63 @@
+#pragma once
+
+#include "bounds.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+
+// Material without a texture, see Material::texture.
+constexpr uint32_t NO_TEXTURE = UINT32_MAX;
+
+
+struct Material
+{
+    // Multiplies the texture if there is one.
+    sf::Color color;
+    // Index into the textures of the scene. Only meshes with uvs are textured.
+    uint32_t texture = NO_TEXTURE;
+};
+
+
+// Cluster of neighboring triangles with the bounds to cull it as a whole, see build_meshlets.
+struct Meshlet
+{
+    // Triangles [triangle_offset, triangle_offset + triangle_count) of the mesh. Their corners are also stored as
+    // indices into meshlet_vertices[vertex_offset, vertex_offset + vertex_count), at the same position in meshlet_triangles.
+    uint32_t triangle_offset;
+    uint32_t triangle_count;
+    uint32_t vertex_offset;
+    uint32_t vertex_count;
+
+    BoundingSphere sphere;
+    // Normals of all triangles lie within the cone, so all of them face away from a viewer outside the sphere when
+    // dot(center - viewer, cone_axis) >= cone_cutoff * |center - viewer| + radius. A cutoff of 1 never culls.
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+
+// Indexed triangle mesh with each vertex attribute in its own contiguous stream.
+struct Mesh
+{
+    std::vector<glm::vec3> positions;
+    // Either empty or one entry per position.
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> uvs;
+
+    // Three vertex indices per triangle.
+    std::vector<uint32_t> indices;
+    // One entry per triangle, indexing materials.
+    std::vector<uint16_t> material_ids;
+    std::vector<Material> materials;
+
+    // Empty until build_meshlets ran, which also reorders the triangles so each meshlet is one range of them.
+    std::vector<Meshlet> meshlets {};
+    std::vector<uint32_t> meshlet_vertices {};
+    // Three local vertex indices per triangle.
+    std::vector<uint8_t> meshlet_triangles {};
+
+    size_t get_triangle_count() const { return indices.size() / 3; }
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "obj_parser.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// Binary mesh cache stored next to the source as "<source>.rmesh". The header is followed by the streams of the mesh
+// and then of each of its levels of detail (positions, normals, uvs, indices, material ids, materials, meshlets, meshlet
+// vertices, meshlet triangles), each starting on a 64 byte boundary, in native byte order.
+
+
+// Content hash of the source file, computed over fixed size blocks in parallel.
+uint64_t hash_source(std::string_view data, uint32_t thread_count = 0);
+
+// Returns false if the cache is missing, from another version, built from different source contents or holds
+// out of range indices.
+bool read_mesh_cache(const std::string &cache_path, uint64_t source_hash, uint64_t source_size, Mesh &mesh, std::vector<Mesh> &lods);
+
+// Written to a temporary file first and renamed, so readers never see a partial cache.
+void write_mesh_cache(const std::string &cache_path, uint64_t source_hash, uint64_t source_size, const Mesh &mesh, const std::vector<Mesh> &lods);
+
+// Loads an OBJ file as a welded mesh split into meshlets, with its chain of levels of detail down to LOD_MIN_TRIANGLES,
+// through its cache, parsing it and writing the cache the first time or when the source changed.
+Mesh load_obj_cached(const std::string &path, std::vector<Mesh> &lods, uint32_t thread_count = 0);
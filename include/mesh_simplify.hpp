@@ -0,0 +1,20 @@
+#pragma once
+
+#include "mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+
+// Meshes are only simplified down to this many triangles, below it vertex work is no longer worth saving.
+constexpr size_t LOD_MIN_TRIANGLES = 128;
+
+
+// Quadric error edge collapse down to about target_triangles. Vertices move onto a neighbor, so attributes are
+// kept as they are. Vertices on open borders, on attribute seams and at non-manifold edges never move, which
+// keeps the outline and avoids cracks but may stop the collapse above the target.
+Mesh simplify_mesh(const Mesh &mesh, size_t target_triangles);
+
+// Progressively coarser copies of mesh, each simplified from the previous one to half its triangles.
+// Stops before a level would drop below min_triangles or when simplification stalls.
+std::vector<Mesh> build_lod_chain(const Mesh &mesh, size_t min_triangles);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "mesh.hpp"
+
+#include <cstdint>
+
+
+// Local vertex indices fit in a byte and a meshlet's vertices in a few transform batches.
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+
+// Greedily grows meshlets from a seed triangle, adding the neighbor that brings the fewest new vertices, and
+// reorders the triangles and material ids of mesh to meshlet order. Meshlets of disconnected parts may be merged.
+void build_meshlets(Mesh &mesh);
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "bounds.hpp"
+#include "bvh.hpp"
+#include "lights.hpp"
+#include "mesh.hpp"
+#include "mesh_simplify.hpp"
+#include "meshlets.hpp"
+#include "texture.hpp"
+#include "vertex_transform.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+struct Model 
+{
+    std::string name;
+    Mesh mesh;
+
+    // Object space bounds of mesh.positions, see update_bounds.
+    Aabb bounds {};
+    BoundingSphere sphere {};
+
+    // Coarser copies of mesh, each with about half the triangles of the one before. The bounds of mesh cover them.
+    std::vector<Mesh> lods {};
+    // Off for meshes that have to be drawn at full detail whatever their size on screen.
+    bool generate_lods = true;
+
+    void update_bounds()
+    {
+        bounds = compute_bounds(mesh.positions);
+        sphere = compute_bounding_sphere(mesh.positions, bounds);
+    }
+
+    // Level 0 is mesh itself.
+    const Mesh &get_lod(uint32_t level) const { return level == 0 ? mesh : lods[level - 1]; }
+    uint32_t get_lod_count() const { return static_cast<uint32_t>(lods.size()) + 1; }
+};
+
+
+inline const Model cube {
+    "Cube", 
+    {
+        {
+            { 1.0f,  1.0f,  1.0f }, {-1.0f,  1.0f,  1.0f }, {-1.0f, -1.0f,  1.0f }, { 1.0f, -1.0f,  1.0f },
+            { 1.0f,  1.0f, -1.0f }, {-1.0f,  1.0f, -1.0f }, {-1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }
+        },
+        {},
+        {},
+        {
+            0, 1, 2,
+            0, 2, 3,
+
+            4, 0, 3,
+            4, 3, 7,
+
+            5, 4, 7,
+            5, 7, 6,
+
+            1, 5, 6,
+            1, 6, 2,
+
+            4, 5, 1,
+            4, 1, 0,
+
+            2, 6, 7,
+            2, 7, 3
+        },
+        { 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5 },
+        {
+            { sf::Color::Blue },
+            { sf::Color::Red },
+            { sf::Color::Green },
+            { sf::Color::Yellow },
+            { sf::Color::Cyan },
+            { sf::Color::Magenta }
+        }
+    }
+};
+
+
+struct ModelTransform
+{
+    glm::mat4 model;
+
+    ModelTransform() : model(1.0f) {}
+
+    ModelTransform(glm::vec3 _scale, glm::vec3 _rotate, float _angle, glm::vec3 _translate)
+    {
+        model = glm::mat4(1.0f);
+        model = glm::translate(model, _translate);
+        model = glm::rotate(model, glm::radians(_angle), _rotate);
+        model = glm::scale(model, _scale);
+    }
+};
+
+
+// Index of a model in a ModelRegistry.
+using ModelHandle = uint32_t;
+
+
+// Owns every model of a scene once, instances refer to them by handle.
+class ModelRegistry
+{
+public:
+    ModelHandle add(Model model)
+    {
+        model.update_bounds();
+        if (model.generate_lods && model.lods.empty())
+            model.lods = build_lod_chain(model.mesh, LOD_MIN_TRIANGLES);
+
+        // Meshes from the mesh cache come with their levels of detail and meshlets.
+        if (model.mesh.meshlets.empty())
+            build_meshlets(model.mesh);
+        for (Mesh &lod : model.lods)
+        {
+            if (lod.meshlets.empty())
+                build_meshlets(lod);
+        }
+        models.push_back(std::move(model));
+        return static_cast<ModelHandle>(models.size() - 1);
+    }
+
+    const Model &get(ModelHandle handle) const { return models[handle]; }
+    size_t size() const { return models.size(); }
+
+private:
+    std::vector<Model> models;
+};
+
+
+// Versions come from one global counter, so two cameras or two transforms never share one.
+inline uint64_t next_version()
+{
+    static std::atomic<uint64_t> counter {0};
+    return ++counter;
+}
+
+
+// Vertex stage output of an instance and the state it was computed from.
+struct VertexCache
+{
+    TransformedVertices vertices;
+    uint64_t camera_version = 0;
+    uint64_t transform_version = 0;
+    uint64_t projection_version = 0;
+    uint32_t lod = 0;
+};
+
+
+// Placement of a registered model, its size does not depend on the size of the mesh.
+struct ModelInstance 
+{
+    ModelHandle model;
+    ModelTransform transform;
+    uint64_t transform_version = 0;
+    // Level of detail drawn last frame, the renderer only moves away from it past a margin.
+    uint32_t lod = 0;
+
+    // Object space bounds of the model and their world space counterparts, which follow the transform.
+    Aabb bounds;
+    BoundingSphere sphere;
+    Aabb world_bounds;
+    BoundingSphere world_sphere;
+
+    // Only allocated for meshes large enough that skipping their vertex work pays for the memory.
+    std::unique_ptr<VertexCache> vertex_cache;
+
+    ModelInstance(ModelHandle _model, const Model &_source, const ModelTransform &_transform) : model(_model), bounds(_source.bounds), sphere(_source.sphere)
+    {
+        set_transform(_transform);
+    }
+
+
+    // Changing transform directly skips dirty tracking, the cached vertices and bounds would stay stale.
+    void set_transform(const ModelTransform &_transform)
+    {
+        transform = _transform;
+        transform_version = next_version();
+        world_bounds = transform_bounds(bounds, transform.model);
+        world_sphere = transform_bounding_sphere(sphere, transform.model);
+    }
+};
+
+
+struct Scene
+{
+    ModelRegistry models;
+    std::vector<ModelInstance> instances;
+    // Indexed by Material::texture.
+    std::vector<Texture> textures;
+    // With lights every surface is shaded by them per pixel, without any material colors are drawn unlit.
+    std::vector<PointLight> lights;
+    glm::vec3 ambient_light = glm::vec3(0.1f);
+
+    // Hierarchy over the world bounds of instances, see update_bvh.
+    Bvh bvh;
+    std::vector<Aabb> bvh_bounds;
+    std::vector<uint64_t> bvh_versions;
+
+    ModelInstance &add_instance(ModelHandle model, const ModelTransform &transform)
+    {
+        instances.emplace_back(model, models.get(model), transform);
+        return instances.back();
+    }
+
+
+    // Refits the hierarchy to instances that moved and rebuilds it when instances were added or removed.
+    void update_bvh()
+    {
+        bool rebuild = bvh_versions.size() != instances.size();
+        bool refit = false;
+
+        bvh_bounds.resize(instances.size());
+        bvh_versions.resize(instances.size());
+        for (size_t i = 0; i < instances.size(); i++)
+        {
+            if (bvh_versions[i] == instances[i].transform_version)
+                continue;
+
+            bvh_bounds[i] = instances[i].world_bounds;
+            bvh_versions[i] = instances[i].transform_version;
+            refit = true;
+        }
+
+        if (rebuild)
+            bvh.build(bvh_bounds);
+        else if (refit)
+            bvh.refit(bvh_bounds);
+    }
+};
+
+
+class Camera
+{
+public:
+    glm::vec3 position;
+    glm::vec3 rotate;
+    float angle;
+    glm::mat4 view;
+    uint64_t version = 0;
+
+    Camera(glm::vec3 _position, glm::vec3 _rotate, float _angle) : position(_position), rotate(_rotate), angle(_angle)
+    {
+        update_transform();
+    }
+
+    void update_transform()
+    {
+        // glm::mat4 camera_rotate = glm::inverse(glm::rotate(glm::radians(angle), rotate));
+        // glm::mat4 camera_translate = glm::translate(position);
+        
+        view = glm::mat4(1.0f);
+        view = glm::translate(view, position);
+        view = glm::inverse(glm::rotate(view, glm::radians(angle), rotate));
+        version = next_version();
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "mesh.hpp"
+
+#include <glm/glm.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+// One face corner. Indices are zero-based and already resolved if negative, -1 when the corner has no uv or normal.
+struct ObjIndex
+{
+    int32_t position;
+    int32_t uv;
+    int32_t normal;
+};
+
+
+struct ObjData
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+
+    // Faces fan-triangulated, three corners per triangle.
+    std::vector<ObjIndex> indices;
+};
+
+
+// The file is memory mapped and split into line-aligned chunks that are parsed in parallel.
+// thread_count == 0 uses every hardware thread. Throws std::runtime_error on malformed input.
+ObjData parse_obj(const std::string &path, uint32_t thread_count = 0);
+
+ObjData parse_obj_text(std::string_view text, uint32_t thread_count = 0);
+
+// Welds the corners into a mesh where every distinct position/uv/normal combination is one vertex.
+// All triangles get material 0, a white default material.
+Mesh build_mesh(const ObjData &obj);
+
+// Parses the file and a generated grid mesh of about synthetic_megabytes, printing the throughput of each.
+void benchmark_obj_parser(const std::string &path, size_t synthetic_megabytes, uint32_t thread_count = 0);
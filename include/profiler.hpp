@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+// Timing markers and counters, recorded into one ring buffer per thread and exported as Chrome trace JSON.
+// Recording takes no locks, it is a relaxed load when disabled. Exports and summaries read the buffers
+// without synchronizing with writers, so they should run between frames.
+class Profiler
+{
+public:
+    // Events kept per thread, older ones are overwritten.
+    static constexpr uint64_t RING_CAPACITY = 1 << 16;
+
+    static Profiler &get();
+    static uint64_t now_ns();
+
+    void set_enabled(bool _enabled) { enabled.store(_enabled, std::memory_order_relaxed); }
+    bool is_enabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // name must outlive the profiler, string literals in practice.
+    void record_scope(const char *name, uint64_t start_ns, uint64_t end_ns);
+    void record_counter(const char *name, int64_t value);
+
+    void write_chrome_trace(const std::string &path) const;
+    // Per marker count, total, average and maximum time, per counter its last value and average.
+    void write_summary(std::ostream &out) const;
+
+private:
+    struct Event
+    {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        int64_t value;
+        bool counter;
+    };
+
+    // Written only by its own thread, head counts every event ever recorded.
+    struct ThreadBuffer
+    {
+        uint32_t thread_id;
+        std::unique_ptr<Event[]> events;
+        std::atomic<uint64_t> head {0};
+    };
+
+    std::atomic<bool> enabled {false};
+    const uint64_t origin_ns = now_ns();
+
+    // Guards registration of new threads and exports, never taken while recording.
+    mutable std::mutex buffers_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    ThreadBuffer &get_thread_buffer();
+    void push(const Event &event);
+    std::vector<std::pair<uint32_t, Event>> collect_events() const;
+};
+
+
+// Records the time between construction and destruction under name, if the profiler was enabled at construction.
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *_name) : name(_name), start_ns(Profiler::get().is_enabled() ? Profiler::now_ns() : 0) {}
+
+    ~ProfileScope()
+    {
+        if (start_ns != 0)
+            Profiler::get().record_scope(name, start_ns, Profiler::now_ns());
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name;
+    uint64_t start_ns;
+};
+
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
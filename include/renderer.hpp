@@ -0,0 +1,430 @@
+#pragma once
+
+#include "depth_pyramid.hpp"
+#include "fragment_pipeline.hpp"
+#include "lights.hpp"
+#include "model.hpp"
+#include "span_kernels.hpp"
+#include "texture.hpp"
+#include "thread_pool.hpp"
+#include "vertex_transform.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+
+// Instance and triangle counts of the last frame, per culling stage outcome.
+struct PrimitiveStats
+{
+    uint64_t instances = 0;
+    uint64_t instances_culled = 0;
+    uint64_t instances_occluded = 0;
+    // Instances drawn with a coarser level of detail than their full mesh.
+    uint64_t instances_reduced_lod = 0;
+    // Meshlets of drawn instances, those rejected as a whole never reach the vertex or setup stage.
+    uint64_t meshlets = 0;
+    uint64_t meshlets_frustum_culled = 0;
+    uint64_t meshlets_backface_culled = 0;
+    uint64_t submitted = 0;
+    uint64_t frustum_culled = 0;
+    uint64_t backface_culled = 0;
+    uint64_t clipped = 0;
+    uint64_t rasterized = 0;
+    // Per tile, a triangle that covers several tiles is counted once in each.
+    uint64_t tile_triangles = 0;
+    uint64_t tile_triangles_occluded = 0;
+    // Pixels inside rasterized triangles that reached the depth test.
+    uint64_t fragments = 0;
+    // Fragments that passed the depth test and were written, the rest were rejected by it.
+    uint64_t shaded = 0;
+    // Pixels colored by the visibility buffer resolve, each visible pixel once.
+    uint64_t resolved = 0;
+    // Lights that reach into the view, light tiles with lit pixels and the lights kept for them, summed over those.
+    uint64_t lights = 0;
+    uint64_t lit_tiles = 0;
+    uint64_t tile_lights = 0;
+};
+
+
+// Color target of a frame with the clear state of each of its tiles. A clear only marks tiles, their memory is
+// written when a triangle first lands in them or when the buffer is read.
+struct ColorBuffer
+{
+    struct Tile
+    {
+        bool pending = false;
+        // The memory holds nothing but uniform_color, so clearing to it again writes nothing.
+        bool uniform = true;
+        uint32_t uniform_color = 0;
+    };
+
+    std::unique_ptr<uint8_t[]> pixels;
+    std::vector<Tile> tiles;
+};
+
+
+// Stage times of the last frame in milliseconds. Transform and setup are summed over threads,
+// geometry is the wall time of both together, clear covers the last call to clear.
+struct FrameTimings
+{
+    double clear_ms = 0.0;
+    double transform_ms = 0.0;
+    double setup_ms = 0.0;
+    double geometry_ms = 0.0;
+    double raster_ms = 0.0;
+    double resolve_ms = 0.0;
+};
+
+
+class Renderer
+{
+public:
+    // thread_count == 0 uses every hardware thread.
+    Renderer(int32_t width, int32_t height, uint32_t thread_count = 0, DepthFormat depth_format = DepthFormat::Float32);
+
+    void clear(const sf::Color &color);
+    void render_scene(Scene &scene, const Camera &camera);
+
+    int32_t get_width() const { return WIDTH; }
+    int32_t get_height() const { return HEIGHT; }
+    uint32_t get_thread_count() const { return thread_pool.get_thread_count(); }
+    const char *get_span_kernels_name() const { return span_kernels->name; }
+    DepthFormat get_depth_format() const { return DEPTH_FORMAT; }
+    PrimitiveStats get_primitive_stats() const;
+    FrameTimings get_frame_timings() const;
+
+    void set_span_kernels(SpanKernelIsa isa) { span_kernels = &get_span_kernels(isa); }
+    void set_backface_culling(bool enabled) { backface_culling = enabled; }
+    // Renders large instances first and tests the others against their depth before transforming them.
+    void set_occluder_pass(bool enabled) { occluder_pass = enabled; }
+    // Draws instances with the level of detail that fits their size on screen, otherwise always the full mesh.
+    void set_lod_selection(bool enabled) { lod_selection = enabled; }
+    // Keeps the level of detail of the last frame unless the size on screen moved past a margin, which stops popping
+    // back and forth but makes the choice depend on the frames rendered before.
+    void set_lod_hysteresis(bool enabled) { lod_hysteresis = enabled; }
+    // Rasterizes depth and triangle ids only and colors each visible pixel once afterwards, so shading cost follows
+    // the resolution instead of the overdraw.
+    void set_visibility_buffer(bool enabled);
+    bool get_visibility_buffer() const { return visibility_buffer != nullptr; }
+    // 1, 4 or 8 samples per pixel. Coverage and depth are tested per sample while shading runs once per pixel, and
+    // get_pixels averages the samples. Can't be combined with the visibility buffer, changing it discards the depth.
+    void set_sample_count(uint32_t count);
+    uint32_t get_sample_count() const { return sample_count; }
+    // Clears are deferred per tile, reading a buffer first writes the tiles that were cleared but never drawn to.
+    const uint8_t *get_pixels();
+    // Decodes the depth buffer to 1/w.
+    void read_depth(std::vector<float> &depth);
+
+    // Zeroed buffer of the renderer's size.
+    ColorBuffer create_color_buffer() const;
+    // Exchanges the render target with buffer, which receives the current frame with every clear resolved.
+    void swap_color_buffer(ColorBuffer &buffer);
+
+private:
+    static constexpr int32_t TILE_SIZE = 64;
+    // Lights are culled per square of this size inside each tile, against the depth bounds of its pixels.
+    static constexpr int32_t LIGHT_TILE_SIZE = 16;
+    static constexpr int32_t LIGHT_TILES_X = TILE_SIZE / LIGHT_TILE_SIZE;
+    static constexpr int32_t LIGHT_TILE_COUNT = LIGHT_TILES_X * LIGHT_TILES_X;
+    static constexpr uint32_t NO_TRIANGLE = UINT32_MAX;
+    static constexpr uint32_t MAX_SAMPLES = 8;
+
+    struct Rect
+    {
+        int32_t min_x;
+        int32_t min_y;
+        int32_t max_x;
+        int32_t max_y;
+    };
+
+    enum class Shading : uint8_t
+    {
+        Flat,
+        Textured,
+        Lit
+    };
+
+    // Edge functions in 1/16 pixel fixed point with the fill rule bias folded into c, plus the depth plane.
+    struct TriangleSetup
+    {
+        int64_t a[3];
+        int64_t b[3];
+        int64_t c[3];
+        int64_t x0;
+        int64_t y0;
+        Rect bounds;
+        double depth_dx;
+        double depth_dy;
+        // Scale from edge coefficients to plane gradients, for planes of other attributes.
+        double inv_area;
+        float depth;
+        // Closest depth anywhere on the triangle, slightly enlarged to cover interpolation error, in depth format units.
+        float max_depth;
+        // Range of 1/w over the triangle, which tiles cull their lights against.
+        float min_inv_w;
+        float max_inv_w;
+        sf::Color color;
+        Shading shading;
+        // Index into the textured or lit triangles of the thread that set this one up, by shading.
+        uint32_t varyings;
+        // Vertices 1 and 2 were swapped to make the area positive, attributes have to follow.
+        bool flipped;
+    };
+
+    struct TexturedTriangle
+    {
+        VaryingPlanes<TextureVaryings> planes;
+        TextureShader shader;
+    };
+
+    // The shader gets the lights of each tile it is drawn in.
+    struct LitTriangle
+    {
+        VaryingPlanes<LitVaryings> planes;
+        LitShader shader;
+    };
+
+    // Vertex attributes of an instance beyond positions, read at the indices of its triangles. uvs are read for
+    // textured triangles, normals in object space when the scene has lights. Without normals lit triangles get
+    // their face normal.
+    struct VertexAttributes
+    {
+        const glm::vec2 *uvs;
+        const glm::vec3 *normals;
+        // Object to view space.
+        glm::mat3 normal_matrix;
+    };
+
+    // Corner attributes of one triangle, only those its shading needs are filled in. Positions are in view space.
+    struct TriangleAttributes
+    {
+        glm::vec3 positions[3];
+        glm::vec3 normals[3];
+        glm::vec2 uvs[3];
+    };
+
+    // Screen rect and 1/w range a light can reach, both conservative.
+    struct LightBounds
+    {
+        Rect rect;
+        float min_inv_w;
+        float max_inv_w;
+    };
+
+    enum class SetupResult
+    {
+        Accepted,
+        BackFacing,
+        Rejected
+    };
+
+    // Inclusive screen rect and closest depth, in depth format units, of an instance that waits for the occlusion test.
+    struct InstanceBounds
+    {
+        uint32_t index;
+        Rect rect;
+        float nearest_depth;
+    };
+
+    // Meshlets [meshlet_first, meshlet_first + meshlet_count) of instances [first, first + count) of a pass list,
+    // all of the same model and level of detail. Instances with many meshlets are split over several batches.
+    struct InstanceBatch
+    {
+        uint32_t first;
+        uint32_t count;
+        uint32_t meshlet_first;
+        uint32_t meshlet_count;
+    };
+
+    // Entries [begin, end) of a tile bin of the thread context source, all from one batch.
+    struct BinRun
+    {
+        uint32_t batch;
+        uint32_t source;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    // Deferred clear of one depth tile, see ColorBuffer.
+    struct DepthTile
+    {
+        bool pending = false;
+        bool uniform = true;
+    };
+
+    // Geometry output of one worker: its triangles and, per tile, the indices of those that touch it.
+    struct ThreadContext
+    {
+        // Vertices of the meshlet being drawn when its mesh has no vertex cache.
+        TransformedVertices meshlet_vertices;
+        // Texture of each material of the mesh being drawn.
+        std::vector<const Texture *> material_textures;
+        std::vector<TriangleSetup> triangles;
+        std::vector<TexturedTriangle> textured;
+        std::vector<LitTriangle> lit;
+        // Lights of each light tile of the tile being drawn, those of light tile i at
+        // [light_tile_offsets[i], light_tile_offsets[i + 1]). candidate_lights reach the tile as a whole.
+        std::vector<ViewLight> tile_lights;
+        uint32_t light_tile_offsets[LIGHT_TILE_COUNT + 1];
+        std::vector<uint32_t> candidate_lights;
+        // Per tile, indices into triangles and the runs of them each batch binned. Which context sets up a batch
+        // depends on work stealing, tiles draw the runs in batch order so that depth ties resolve the same every time.
+        std::vector<std::vector<uint32_t>> bins;
+        std::vector<std::vector<BinRun>> bin_runs;
+        // The batch being set up, and the runs of all contexts for the tile being drawn.
+        uint32_t batch = 0;
+        std::vector<BinRun> tile_runs;
+        PrimitiveStats stats;
+        double transform_ms = 0.0;
+        double setup_ms = 0.0;
+    };
+
+    const int32_t WIDTH;
+    const int32_t HEIGHT;
+    const DepthFormat DEPTH_FORMAT;
+    const size_t DEPTH_SIZE;
+
+    ColorBuffer color_buffer;
+    // Pixels of DEPTH_SIZE bytes in the storage of DEPTH_FORMAT.
+    std::unique_ptr<uint8_t[]> depth_buffer;
+    std::vector<DepthTile> depth_tiles;
+    DepthPyramid depth_pyramid;
+    uint32_t clear_color = 0;
+    // Per pixel (triangle index << context_bits) | thread context of the triangle drawn there, NO_TRIANGLE once
+    // resolved. Only allocated in visibility buffer mode.
+    std::unique_ptr<uint32_t[]> visibility_buffer;
+    // Tiles with ids waiting for the resolve.
+    std::vector<uint8_t> visibility_tiles;
+    uint32_t context_bits = 0;
+
+    uint32_t sample_count = 1;
+    // Sample positions relative to the pixel center in 1/16 pixel, and the largest coordinate among them.
+    int64_t sample_x[MAX_SAMPLES] = {};
+    int64_t sample_y[MAX_SAMPLES] = {};
+    int64_t sample_extent = 0;
+    // With multisampling the samples of a pixel are next to each other, depth in the storage of DEPTH_FORMAT.
+    // depth_buffer then holds the farthest sample of each pixel, which is all the depth pyramid needs.
+    std::unique_ptr<uint8_t[]> sample_depth;
+    // Pixels whose sample depths were written since the last clear. The others read as cleared, so a clear resets
+    // one byte per pixel instead of every sample.
+    std::unique_ptr<uint8_t[]> depth_written;
+    // A pixel stores a single color in pixels until a triangle writes only some of its samples. Then it is split and
+    // its samples get their own colors here, which get_pixels averages into pixels.
+    std::unique_ptr<uint32_t[]> sample_colors;
+    std::unique_ptr<uint8_t[]> split_pixels;
+    // Tiles with split pixels, those without any are complete in pixels and skip the resolve.
+    std::vector<uint8_t> split_tiles;
+
+    const SpanKernels *span_kernels = &get_span_kernels();
+    ThreadPool thread_pool;
+    std::vector<ThreadContext> contexts;
+    std::vector<uint32_t> visible_instances;
+    std::vector<uint32_t> pass_instances;
+    std::vector<InstanceBounds> occludees;
+    std::vector<InstanceBatch> batches;
+    size_t instance_count = 0;
+    size_t instances_occluded = 0;
+    size_t instances_reduced_lod = 0;
+    FrameTimings timings;
+    int32_t tiles_x = 0;
+    int32_t tiles_y = 0;
+
+    float d = 1.0f;
+    int32_t viewport_width = 1;
+    int32_t viewport_height = 1;
+
+    glm::mat4 projection;
+    uint64_t projection_version = 0;
+    ScreenMapping screen_mapping;
+    ClipPlanes clip_planes;
+    bool backface_culling = true;
+    bool occluder_pass = true;
+    bool lod_selection = true;
+    bool lod_hysteresis = true;
+
+    // Lights of the current frame in view space, those out of view dropped, and where they reach.
+    std::vector<ViewLight> view_lights;
+    std::vector<LightBounds> light_bounds;
+    glm::vec3 ambient_light = glm::vec3(0.0f);
+    // The scene has lights, every triangle of the frame is lit.
+    bool lighting = false;
+
+    void *depth_at(size_t offset) { return depth_buffer.get() + offset * DEPTH_SIZE; }
+    void clear_depth_buffer();
+    void fill(const sf::Color &color);
+
+    // Depth tests and shades the pixels of a set up triangle inside rect, adding them to stats.
+    template <typename Varyings, typename Shader>
+    void shade_triangle(const TriangleSetup &triangle, const VaryingPlanes<Varyings> &planes, const Shader &shader, const Rect &rect, PrimitiveStats &stats);
+    // Colors the pixels [x_begin, x_end) of row y, all of which the triangle won.
+    template <typename Varyings, typename Shader>
+    void shade_visible(const TriangleSetup &triangle, const VaryingPlanes<Varyings> &planes, const Shader &shader, int32_t y, int32_t x_begin, int32_t x_end);
+
+    // The projection only scales x and y, so view space is recovered from clip space.
+    glm::vec3 clip_to_view(float x, float y, float w) const { return glm::vec3(x / projection[0][0], y / projection[1][1], w); }
+    SetupResult setup_triangle(const glm::vec2 &v0, const glm::vec2 &v1, const glm::vec2 &v2, float d0, float d1, float d2, const sf::Color &color, bool cull_back_faces, TriangleSetup &triangle);
+    // Calls span(y, x_begin, x_end, offset_x, offset_y) for each row of the triangle inside rect with x_end exclusive,
+    // offsets are from vertex 0 to the center of the first pixel. Returns the number of fragments.
+    template <typename SpanFunction>
+    uint64_t walk_spans(const TriangleSetup &triangle, const Rect &rect, SpanFunction &&span) const;
+    // Smallest and largest change of edge function i from the center of a pixel to its samples.
+    void edge_sample_range(const TriangleSetup &triangle, int32_t i, int64_t &lowest, int64_t &highest) const;
+    // walk_spans for multisampling: calls span(y, x_begin, x_end, inner_begin, inner_end, offset_x, offset_y) for the
+    // pixels with any sample inside, those in [inner_begin, inner_end) have all of them inside.
+    template <typename SpanFunction>
+    uint64_t walk_sample_spans(const TriangleSetup &triangle, const Rect &rect, SpanFunction &&span) const;
+    // Bit s set for each sample of pixel x, y inside the triangle.
+    uint32_t coverage_mask(const TriangleSetup &triangle, int64_t x, int64_t y) const;
+    // Depth tests the samples of a span from walk_sample_spans with 1/w depth at x_begin and colors the pixels where
+    // any passed with shade(t, inv_w), t steps from x_begin. Returns the number of those pixels. SAMPLES is
+    // sample_count as a constant, so the loops over samples unroll.
+    template <typename Format, uint32_t SAMPLES, typename ShadeFunction>
+    uint32_t shade_sample_span(const TriangleSetup &triangle, int64_t y, int64_t x_begin, int64_t x_end, int64_t inner_begin, int64_t inner_end, float depth, ShadeFunction &&shade);
+    // Depth tests the samples in mask of the pixel at offset, sample s at depth + sample_depth_offsets[s], and colors
+    // those that pass with shade(), called at most once. Returns whether any passed.
+    template <typename Format, uint32_t SAMPLES, typename ShadeFunction>
+    bool write_samples(size_t offset, uint32_t mask, float depth, const float *sample_depth_offsets, ShadeFunction &&shade);
+    // Adds the fragments and shaded pixels of the triangle inside rect to stats.
+    void rasterize_triangle(const TriangleSetup &triangle, const Rect &rect, PrimitiveStats &stats);
+    uint32_t draw_span(int32_t y, int32_t x_begin, int32_t x_end, float depth, float depth_step, const sf::Color &color);
+    // Depth tests the triangle like rasterize_triangle but writes id to the visibility buffer.
+    void rasterize_visibility(const TriangleSetup &triangle, uint32_t id, const Rect &rect, PrimitiveStats &stats);
+
+    // Brings the lights of the scene to view space and bounds them on screen.
+    void prepare_lights(const Scene &scene, const Camera &camera);
+    // Fills the light lists of the light tiles of the tile at rect, each with the lights that can reach its pixels
+    // with 1/w in [min_inv_w[i], max_inv_w[i]]. An empty range gets no lights.
+    void build_tile_lights(const Rect &rect, const float *min_inv_w, const float *max_inv_w, ThreadContext &context) const;
+    Rect light_tile_rect(const Rect &rect, int32_t light_tile) const;
+    static bool light_reaches(const LightBounds &bounds, const Rect &rect, float min_inv_w, float max_inv_w);
+    // Copy of shader that lights with the lights of one light tile of context.
+    static LitShader with_lights(const LitShader &shader, const ThreadContext &context, int32_t light_tile);
+    // Picks the level of detail of each visible instance from the pixel radius of its bounding sphere.
+    void select_lods(Scene &scene, const glm::mat4 &view_projection);
+    void render_instances(Scene &scene, const Camera &camera, const std::vector<uint32_t> &instances);
+    bool project_bounds(const Aabb &bounds, const glm::mat4 &view_projection, Rect &rect, float &nearest_depth) const;
+    void render_batch(Scene &scene, const Camera &camera, const InstanceBatch &batch, const uint32_t *instances, ThreadContext &context);
+    const TransformedVertices &update_vertex_cache(ModelInstance &instance, const Mesh &mesh, const Camera &camera, const glm::mat4 &view_projection);
+    template <typename Index>
+    void render_triangle(const Index *indices, const sf::Color &color, const Texture *texture, const VertexAttributes &attributes, const TransformedVertices &vertices, ThreadContext &context);
+    // corners are the attributes of the unclipped triangle.
+    void render_clipped_triangle(const ClipVertex *triangle, uint16_t clip_codes, const sf::Color &color, const Texture *texture, const TriangleAttributes &corners, ThreadContext &context);
+    void submit_triangle(const glm::vec2 &v0, const glm::vec2 &v1, const glm::vec2 &v2, float d0, float d1, float d2, const sf::Color &color, const Texture *texture, const TriangleAttributes &corners, ThreadContext &context);
+    void bin_triangle(const TriangleSetup &triangle, uint32_t index, ThreadContext &context);
+    bool triangle_overlaps_tile(const TriangleSetup &triangle, const Rect &rect) const;
+    Rect tile_rect(int32_t tile_x, int32_t tile_y) const;
+    void render_tile(uint32_t tile, ThreadContext &context);
+    void fill_tile_color(uint32_t tile, uint32_t color);
+    void fill_tile_depth(uint32_t tile);
+    // Averages the samples of the split pixels of a tile into pixels.
+    void resolve_samples(uint32_t tile);
+    // Shades the pixels that got a triangle id since the last resolve and resets their ids.
+    void resolve_visibility();
+    void resolve_tile(uint32_t tile, ThreadContext &context);
+    // Writes the pending clears of a tile that is about to be drawn to.
+    void materialize_tile(uint32_t tile);
+    // Frame counters for the profiler, taken from the primitive stats.
+    void record_counters() const;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "model.hpp"
+
+#include <string>
+
+
+// Two cubes in front of the camera, the default interactive scene.
+Scene create_cubes_scene();
+
+// A size x size grid of rotated cubes around the camera sharing one mesh, only a small part of it is in view.
+Scene create_cube_field_scene(int32_t size = 100);
+
+// layers screen-filling slabs stacked along the view direction, listed back to front so every layer is drawn.
+Scene create_overdraw_scene(int32_t layers = 32);
+
+// One plane facing the camera tessellated into resolution x resolution quads, most triangles smaller than a pixel.
+Scene create_tiny_triangles_scene(int32_t resolution = 512);
+
+// A checkered floor receding from the camera under a few textured cubes, resolution x resolution quads.
+Scene create_textured_scene(int32_t resolution = 64);
+
+// The textured scene lit by light_count small point lights in rows over the floor, few of them near any pixel.
+Scene create_lights_scene(int32_t light_count = 256);
+
+// A single instance of an OBJ mesh placed in front of the camera, faces pre-lit from the camera direction.
+// The mesh is loaded through its binary cache. A texture, if given, is mapped with the mesh's uvs.
+Scene create_obj_scene(const std::string &path, const std::string &texture_path = "");
+
+// A size x size grid of copies of an OBJ mesh receding from the camera, most of them far enough for a coarse level of detail.
+Scene create_obj_crowd_scene(const std::string &path, int32_t size = 16);
+
+// cubes, field, overdraw, tiny, textured, lights or a path to an OBJ file, which gets the texture if there is one.
+Scene create_scene_by_name(const std::string &name, int32_t field_size = 100, const std::string &texture_path = "");
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "depth_format.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <string>
+
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RASTERIZER_X86 1
+#endif
+
+
+// Depth-tested writes of one span of a row. pixels and depth point at the first pixel of the span, depth in the
+// storage of the kernel's depth format. Pixel i gets depth_start + depth_step * i as 1/w and passes when the stored
+// value is smaller than its encoding. Returns the number of pixels written.
+using FlatSpanKernel = int32_t (*)(uint32_t *pixels, void *depth, int32_t count, float depth_start, float depth_step, uint32_t color);
+
+
+// One instantiation per depth format, indexed by DepthFormat.
+struct SpanKernels
+{
+    const char *name;
+    FlatSpanKernel flat[DEPTH_FORMAT_COUNT];
+};
+
+
+enum class SpanKernelIsa
+{
+    Auto,
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+
+// Auto picks the widest instruction set the CPU supports. Throws if the requested one is unavailable.
+const SpanKernels &get_span_kernels(SpanKernelIsa isa = SpanKernelIsa::Auto);
+
+SpanKernelIsa parse_span_kernel_isa(const std::string &name);
+
+
+inline uint32_t pack_color(const sf::Color &color)
+{
+    return static_cast<uint32_t>(color.r) | (static_cast<uint32_t>(color.g) << 8) | (static_cast<uint32_t>(color.b) << 16) | (255u << 24);
+}
+
+
+// Number of set bits, for counting the lanes of a movemask.
+inline int32_t count_bits(uint32_t value)
+{
+    value = value - ((value >> 1) & 0x55555555u);
+    value = (value & 0x33333333u) + ((value >> 2) & 0x33333333u);
+    return static_cast<int32_t>((((value + (value >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24);
+}
+
+
+#ifdef RASTERIZER_X86
+extern const SpanKernels sse2_span_kernels;
+extern const SpanKernels avx2_span_kernels;
+#endif
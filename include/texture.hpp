@@ -0,0 +1,168 @@
+#pragma once
+
+#include "span_kernels.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef RASTERIZER_X86
+#include <emmintrin.h>
+#endif
+
+
+// RGBA8 image with its mip chain down to 1x1. Every level is stored in blocks of 4x4 texels, one cache line each,
+// with the texels of a block in Morton order and the blocks row by row. A bilinear footprint then touches one block
+// most of the time, where row major storage always touches two rows of the image. Sizes are powers of two, so
+// coordinates wrap with a mask.
+class Texture
+{
+public:
+    static constexpr int32_t BLOCK_SIZE = 4;
+
+    // pixels holds width * height texels row by row, the same layout as the color buffer. Other sizes than powers of
+    // two are scaled up to the next one.
+    Texture(int32_t width, int32_t height, const uint8_t *pixels);
+
+    int32_t get_width() const { return levels[0].width; }
+    int32_t get_height() const { return levels[0].height; }
+    uint32_t get_level_count() const { return static_cast<uint32_t>(levels.size()); }
+    uint32_t get_texel(uint32_t level, int32_t x, int32_t y) const { return texel_at(levels[level], x, y); }
+
+    // Bilinear sample of the mip level that matches the screen space derivatives of uv, nearest level. uv wraps.
+    uint32_t sample(const glm::vec2 &uv, const glm::vec2 &ddx, const glm::vec2 &ddy) const;
+
+private:
+    struct alignas(64) Block
+    {
+        uint32_t texels[BLOCK_SIZE * BLOCK_SIZE];
+    };
+
+    struct Level
+    {
+        int32_t width;
+        int32_t height;
+        int32_t blocks_x;
+        size_t first_block;
+    };
+
+    std::vector<Level> levels;
+    std::vector<Block> blocks;
+
+    // Block of the texel and its index inside, whose bits from the lowest are x, y, x, y.
+    static size_t block_of(const Level &level, int32_t x, int32_t y) { return level.first_block + (y >> 2) * level.blocks_x + (x >> 2); }
+    static uint32_t morton_of(int32_t x, int32_t y) { return (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2); }
+
+    uint32_t texel_at(const Level &level, int32_t x, int32_t y) const { return blocks[block_of(level, x, y)].texels[morton_of(x, y)]; }
+
+    uint32_t sample_level(const Level &level, const glm::vec2 &uv) const;
+};
+
+
+// Throws std::runtime_error when the file can't be read.
+Texture load_texture(const std::string &path);
+
+// size x size texels of cells x cells squares alternating between two colors.
+Texture create_checker_texture(int32_t size, int32_t cells, const sf::Color &color0, const sf::Color &color1);
+
+
+inline int32_t floor_to_int(float value)
+{
+    int32_t result = static_cast<int32_t>(value);
+    return result - (value < static_cast<float>(result));
+}
+
+
+// Weights are in 1/128 steps, so the four products of a texel fit in 16 bits and sum to exactly 1 << 14.
+inline uint32_t Texture::sample_level(const Level &level, const glm::vec2 &uv) const
+{
+    float x = uv.x * static_cast<float>(level.width) - 0.5f;
+    float y = uv.y * static_cast<float>(level.height) - 0.5f;
+    int32_t x0 = floor_to_int(x);
+    int32_t y0 = floor_to_int(y);
+    int32_t fx = std::min(static_cast<int32_t>((x - static_cast<float>(x0)) * 128.0f), 127);
+    int32_t fy = std::min(static_cast<int32_t>((y - static_cast<float>(y0)) * 128.0f), 127);
+
+    int32_t x1 = (x0 + 1) & (level.width - 1);
+    int32_t y1 = (y0 + 1) & (level.height - 1);
+    x0 &= level.width - 1;
+    y0 &= level.height - 1;
+
+    uint32_t t00 = texel_at(level, x0, y0);
+    uint32_t t10 = texel_at(level, x1, y0);
+    uint32_t t01 = texel_at(level, x0, y1);
+    uint32_t t11 = texel_at(level, x1, y1);
+
+    int32_t w00 = (128 - fx) * (128 - fy);
+    int32_t w10 = fx * (128 - fy);
+    int32_t w01 = (128 - fx) * fy;
+    int32_t w11 = fx * fy;
+
+#ifdef RASTERIZER_X86
+    // Channels of the two texels of a row interleaved as 16-bit pairs, one multiply-add per row weighs them.
+    const __m128i zero = _mm_setzero_si128();
+    __m128i top = _mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int32_t>(t00)), _mm_cvtsi32_si128(static_cast<int32_t>(t10))), zero);
+    __m128i bottom = _mm_unpacklo_epi8(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int32_t>(t01)), _mm_cvtsi32_si128(static_cast<int32_t>(t11))), zero);
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(top, _mm_set1_epi32(w00 | (w10 << 16))), _mm_madd_epi16(bottom, _mm_set1_epi32(w01 | (w11 << 16))));
+    sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << 13)), 14);
+    __m128i packed = _mm_packs_epi32(sum, sum);
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(packed, packed)));
+#else
+    uint32_t result = 0;
+    for (int32_t shift = 0; shift < 32; shift += 8)
+    {
+        int32_t sum = static_cast<int32_t>((t00 >> shift) & 0xff) * w00 + static_cast<int32_t>((t10 >> shift) & 0xff) * w10
+            + static_cast<int32_t>((t01 >> shift) & 0xff) * w01 + static_cast<int32_t>((t11 >> shift) & 0xff) * w11;
+        result |= static_cast<uint32_t>((sum + (1 << 13)) >> 14) << shift;
+    }
+    return result;
+#endif
+}
+
+
+inline uint32_t Texture::sample(const glm::vec2 &uv, const glm::vec2 &ddx, const glm::vec2 &ddy) const
+{
+    // Squared texels per pixel along the axis that shrinks the texture most, the level is round(log2) of its root.
+    float scale_x = static_cast<float>(levels[0].width);
+    float scale_y = static_cast<float>(levels[0].height);
+    float length_x = ddx.x * ddx.x * scale_x * scale_x + ddx.y * ddx.y * scale_y * scale_y;
+    float length_y = ddy.x * ddy.x * scale_x * scale_x + ddy.y * ddy.y * scale_y * scale_y;
+    float rho_squared = std::max(length_x, length_y) * 2.0f;
+
+    // floor(log2(2 * rho^2)) / 2 from the float exponent, which is round(log2(rho)).
+    uint32_t bits;
+    std::memcpy(&bits, &rho_squared, sizeof(bits));
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127;
+    int32_t level = std::min(std::max(exponent, 0) >> 1, static_cast<int32_t>(levels.size()) - 1);
+    return sample_level(levels[level], uv);
+}
+
+
+// Per pixel uv of a textured triangle.
+struct TextureVaryings
+{
+    glm::vec2 uv;
+};
+
+
+// Texture sample multiplied by a color per channel, white leaves it unchanged.
+struct TextureShader
+{
+    static constexpr bool USES_DERIVATIVES = true;
+
+    const Texture *texture;
+    sf::Color color;
+
+    uint32_t operator()(const TextureVaryings &varyings, const TextureVaryings &ddx, const TextureVaryings &ddy) const
+    {
+        uint32_t texel = texture->sample(varyings.uv, ddx.uv, ddy.uv);
+        uint32_t r = ((texel & 0xff) * (color.r + 1u)) >> 8;
+        uint32_t g = (((texel >> 8) & 0xff) * (color.g + 1u)) >> 8;
+        uint32_t b = (((texel >> 16) & 0xff) * (color.b + 1u)) >> 8;
+        return r | (g << 8) | (b << 16) | (255u << 24);
+    }
+};
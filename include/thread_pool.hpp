@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool
+{
+public:
+    // thread_count == 0 uses every hardware thread. The calling thread counts as one of them.
+    explicit ThreadPool(uint32_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    uint32_t get_thread_count() const { return thread_count; }
+
+    // Calls task(index, thread) for every index in [0, count) and returns when all of them are done.
+    // Each thread starts on its own contiguous range and steals single indices from the others once it runs dry.
+    // If a task throws, the remaining indices are skipped and the first exception is rethrown here.
+    void parallel_for(uint32_t count, const std::function<void(uint32_t, uint32_t)> &task);
+
+private:
+    struct alignas(64) WorkRange
+    {
+        std::atomic<uint32_t> next {0};
+        uint32_t end = 0;
+    };
+
+    uint32_t thread_count;
+    std::vector<std::thread> workers;
+    std::unique_ptr<WorkRange[]> ranges;
+
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable done_condition;
+    const std::function<void(uint32_t, uint32_t)> *current_task = nullptr;
+    uint64_t generation = 0;
+    uint32_t busy_workers = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+    std::atomic<bool> failed {false};
+
+    void worker_loop(uint32_t thread);
+    void run_ranges(uint32_t thread);
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "clipper.hpp"
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+
+// Output of the vertex stage in structure-of-arrays layout.
+struct TransformedVertices
+{
+    // Clip space. w is the view space depth, the depth buffer stores 1/w.
+    std::vector<float> clip_x;
+    std::vector<float> clip_y;
+    std::vector<float> clip_w;
+
+    // Screen space with pixel centers at +0.5, only meaningful for w > 0.
+    std::vector<float> screen_x;
+    std::vector<float> screen_y;
+    std::vector<float> inv_w;
+
+    // ClipCode bits of every vertex.
+    std::vector<uint16_t> clip_codes;
+
+    void resize(size_t count);
+    size_t size() const { return clip_w.size(); }
+};
+
+
+// screen = ndc * scale + offset
+struct ScreenMapping
+{
+    float scale_x;
+    float scale_y;
+    float offset_x;
+    float offset_y;
+};
+
+
+// Transforms positions by mvp, projects and classifies them, four vertices per SSE2 batch on x86.
+void transform_vertices(const glm::vec3 *positions, size_t count, const glm::mat4 &mvp, const ScreenMapping &mapping, const ClipPlanes &planes, TransformedVertices &output);
@@ -0,0 +1,146 @@
+#include "animation_script.hpp"
+
+#include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+
+// Where HeadlessApp and RaytracerApp put the camera.
+static const CameraKey DEFAULT_CAMERA {0, glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f};
+
+
+// The whole token has to be the number.
+template<typename T>
+static bool parse_number(const std::string &token, T &value)
+{
+    const char *end = token.data() + token.size();
+    auto [next, error] = std::from_chars(token.data(), end, value);
+    return error == std::errc() && next == end;
+}
+
+
+static bool parse_vector(const std::vector<std::string> &tokens, size_t first, glm::vec3 &value)
+{
+    return parse_number(tokens[first], value.x) && parse_number(tokens[first + 1], value.y) && parse_number(tokens[first + 2], value.z);
+}
+
+
+AnimationScript load_animation_script(const std::filesystem::path &path)
+{
+    std::ifstream in_file(path);
+    if (!in_file.is_open())
+    {
+        throw std::runtime_error("Can't open animation script " + path.string());
+    }
+
+    AnimationScript script;
+    std::string line;
+    int32_t line_number = 0;
+    while (std::getline(in_file, line))
+    {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream stream(line);
+        std::vector<std::string> tokens;
+        std::string token;
+        while (stream >> token)
+        {
+            tokens.push_back(token);
+        }
+        if (tokens.empty())
+            continue;
+
+        const std::string &statement = tokens[0];
+        bool valid = false;
+        if (statement == "frames" && tokens.size() == 2)
+        {
+            valid = parse_number(tokens[1], script.frame_count) && script.frame_count > 0;
+        }
+        else if (statement == "camera" && (tokens.size() == 6 || tokens.size() == 9))
+        {
+            CameraKey key = DEFAULT_CAMERA;
+            valid = parse_number(tokens[1], key.frame) && parse_vector(tokens, 2, key.position) && parse_number(tokens[5], key.angle);
+            if (tokens.size() == 9)
+                valid = valid && parse_vector(tokens, 6, key.rotate) && glm::dot(key.rotate, key.rotate) > 0.0f;
+            script.camera_keys.push_back(key);
+        }
+        else if (statement == "turntable" && (tokens.size() == 2 || tokens.size() == 5))
+        {
+            valid = parse_number(tokens[1], script.turntable_degrees);
+            if (tokens.size() == 5)
+            {
+                valid = valid && parse_vector(tokens, 2, script.turntable_center);
+                script.turntable_around_bounds = false;
+            }
+        }
+
+        if (!valid)
+            throw std::runtime_error("Malformed animation script line " + std::to_string(line_number) + " of " + path.string() + ": \"" + line + "\"");
+    }
+
+    std::stable_sort(script.camera_keys.begin(), script.camera_keys.end(), [](const CameraKey &a, const CameraKey &b) { return a.frame < b.frame; });
+    return script;
+}
+
+
+AnimationScript create_turntable_script(uint32_t frame_count)
+{
+    AnimationScript script;
+    script.frame_count = std::max(frame_count, 1u);
+    script.turntable_degrees = 360.0f;
+    return script;
+}
+
+
+Camera get_script_camera(const AnimationScript &script, uint32_t frame)
+{
+    const std::vector<CameraKey> &keys = script.camera_keys;
+    if (keys.empty())
+        return Camera(DEFAULT_CAMERA.position, DEFAULT_CAMERA.rotate, DEFAULT_CAMERA.angle);
+
+    auto next = std::upper_bound(keys.begin(), keys.end(), frame, [](uint32_t value, const CameraKey &key) { return value < key.frame; });
+    if (next == keys.begin())
+        return Camera(next->position, next->rotate, next->angle);
+    const CameraKey &previous = *(next - 1);
+    if (next == keys.end())
+        return Camera(previous.position, previous.rotate, previous.angle);
+
+    float t = static_cast<float>(frame - previous.frame) / static_cast<float>(next->frame - previous.frame);
+    return Camera(glm::mix(previous.position, next->position, t), previous.rotate, previous.angle + (next->angle - previous.angle) * t);
+}
+
+
+SceneAnimator::SceneAnimator(const AnimationScript &_script, Scene &_scene) : script(_script), scene(_scene), center(_script.turntable_center)
+{
+    Aabb bounds;
+    base_transforms.reserve(scene.instances.size());
+    for (const ModelInstance &instance : scene.instances)
+    {
+        base_transforms.push_back(instance.transform);
+        bounds.expand(instance.world_bounds);
+    }
+    if (script.turntable_around_bounds && !bounds.is_empty())
+        center = bounds.get_center();
+}
+
+
+void SceneAnimator::apply(uint32_t frame)
+{
+    if (script.turntable_degrees == 0.0f)
+        return;
+
+    float angle = script.turntable_degrees * static_cast<float>(frame) / static_cast<float>(script.frame_count);
+    glm::mat4 turn = glm::translate(center) * glm::rotate(glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::translate(-center);
+
+    for (size_t i = 0; i < scene.instances.size(); i++)
+    {
+        ModelTransform transform;
+        transform.model = turn * base_transforms[i].model;
+        scene.instances[i].set_transform(transform);
+    }
+}
@@ -0,0 +1,261 @@
+#include "batch_renderer.hpp"
+#include "image_writer.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+
+static double elapsed_seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static std::string format_frame_path(const std::string &pattern, uint32_t frame)
+{
+    std::string number = std::to_string(frame);
+
+    size_t first = pattern.find('#');
+    if (first == std::string::npos)
+    {
+        size_t dot = pattern.rfind('.');
+        size_t slash = pattern.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = pattern.size();
+        return format_frame_path(pattern.substr(0, dot) + "_####" + pattern.substr(dot), frame);
+    }
+
+    size_t last = pattern.find_first_not_of('#', first);
+    if (last == std::string::npos)
+        last = pattern.size();
+    if (number.size() < last - first)
+        number.insert(0, last - first - number.size(), '0');
+    return pattern.substr(0, first) + number + pattern.substr(last);
+}
+
+
+BatchRenderer::BatchRenderer(int32_t width, int32_t height, uint32_t worker_count, uint32_t threads_per_worker, uint32_t _writer_count, DepthFormat depth_format, const std::function<void(Renderer &)> &configure, const std::function<Scene()> &create_scene)
+{
+    threads_per_worker = std::max(threads_per_worker, 1u);
+    if (worker_count == 0)
+        worker_count = std::max(std::thread::hardware_concurrency() / threads_per_worker, 1u);
+    writer_count = _writer_count > 0 ? _writer_count : std::max(worker_count / 4, 1u);
+
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        workers.push_back(std::make_unique<Worker>(width, height, threads_per_worker, depth_format));
+        configure(workers.back()->renderer);
+        // Which frames a worker rendered before depends on scheduling, so its levels of detail must not depend on them.
+        workers.back()->renderer.set_lod_hysteresis(false);
+    }
+
+    // Scenes are not shared, rendering updates their hierarchies and vertex caches. The first one is created alone so
+    // that mesh caches are written once, the others only read them.
+    workers.front()->scene = create_scene();
+
+    std::vector<std::thread> loaders;
+    for (uint32_t i = 1; i < worker_count; i++)
+    {
+        loaders.emplace_back([this, i, &create_scene]
+        {
+            try
+            {
+                workers[i]->scene = create_scene();
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        });
+    }
+    for (std::thread &loader : loaders)
+    {
+        loader.join();
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+BatchStats BatchRenderer::run(const AnimationScript &script, const std::string &output_pattern)
+{
+    bool write = !output_pattern.empty();
+
+    // Two buffers per writer keep each of them busy while workers swap finished frames out. The pool is the bound on
+    // frames waiting for the disk, once it is empty workers stall.
+    free_buffers.clear();
+    ready_frames.clear();
+    if (write)
+    {
+        for (uint32_t i = 0; i < writer_count * 2 + get_worker_count(); i++)
+        {
+            free_buffers.push_back(workers.front()->renderer.create_color_buffer());
+        }
+    }
+
+    // Runs of frames small enough that every worker gets several, to even out frames that differ in cost.
+    chunk_size = std::max(script.frame_count / (get_worker_count() * 4), 1u);
+    next_frame = 0;
+    active_workers = get_worker_count();
+    failed = false;
+    error = nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<double> write_seconds(write ? writer_count : 0, 0.0);
+    std::vector<std::thread> threads;
+    for (double &seconds : write_seconds)
+    {
+        threads.emplace_back(&BatchRenderer::write_loop, this, std::cref(output_pattern), std::ref(seconds));
+    }
+    for (std::unique_ptr<Worker> &worker : workers)
+    {
+        worker->render_seconds = 0.0;
+        worker->stall_seconds = 0.0;
+        threads.emplace_back(&BatchRenderer::render_loop, this, std::ref(*worker), std::cref(script), write);
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+
+    BatchStats stats;
+    stats.frames = script.frame_count;
+    stats.wall_seconds = elapsed_seconds(start);
+    for (const std::unique_ptr<Worker> &worker : workers)
+    {
+        stats.render_seconds += worker->render_seconds;
+        stats.stall_seconds += worker->stall_seconds;
+    }
+    for (double seconds : write_seconds)
+    {
+        stats.write_seconds += seconds;
+    }
+    return stats;
+}
+
+
+void BatchRenderer::render_loop(Worker &worker, const AnimationScript &script, bool write)
+{
+    try
+    {
+        SceneAnimator animator(script, worker.scene);
+
+        // Every way out goes through the tail below, which the writers wait for.
+        bool stop = false;
+        while (!stop)
+        {
+            uint32_t first = next_frame.fetch_add(chunk_size);
+            if (first >= script.frame_count || failed)
+                break;
+            uint32_t end = std::min(first + chunk_size, script.frame_count);
+
+            for (uint32_t frame = first; frame < end; frame++)
+            {
+                auto render_start = std::chrono::steady_clock::now();
+                {
+                    PROFILE_SCOPE("batch_frame");
+                    animator.apply(frame);
+                    worker.renderer.clear(sf::Color::Black);
+                    worker.renderer.render_scene(worker.scene, get_script_camera(script, frame));
+                }
+                worker.render_seconds += elapsed_seconds(render_start);
+
+                if (!write)
+                    continue;
+
+                ColorBuffer buffer;
+                {
+                    PROFILE_SCOPE("wait_for_writer");
+                    auto stall_start = std::chrono::steady_clock::now();
+                    std::unique_lock<std::mutex> lock(mutex);
+                    free_condition.wait(lock, [this] { return failed || !free_buffers.empty(); });
+                    if (failed)
+                    {
+                        stop = true;
+                        break;
+                    }
+                    buffer = std::move(free_buffers.back());
+                    free_buffers.pop_back();
+                    worker.stall_seconds += elapsed_seconds(stall_start);
+                }
+
+                // The worker continues into the free buffer while the finished frame goes to the writers.
+                worker.renderer.swap_color_buffer(buffer);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    ready_frames.push_back(OutputFrame { frame, std::move(buffer) });
+                }
+                ready_condition.notify_one();
+            }
+        }
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        active_workers--;
+    }
+    ready_condition.notify_all();
+}
+
+
+void BatchRenderer::write_loop(const std::string &output_pattern, double &write_seconds)
+{
+    const Renderer &renderer = workers.front()->renderer;
+
+    try
+    {
+        while (true)
+        {
+            OutputFrame output;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready_condition.wait(lock, [this] { return failed || !ready_frames.empty() || active_workers == 0; });
+                if (failed || ready_frames.empty())
+                    return;
+                output = std::move(ready_frames.front());
+                ready_frames.pop_front();
+            }
+
+            auto write_start = std::chrono::steady_clock::now();
+            {
+                PROFILE_SCOPE("write_frame");
+                save_color_buffer(format_frame_path(output_pattern, output.frame), output.buffer.pixels.get(), renderer.get_width(), renderer.get_height());
+            }
+            write_seconds += elapsed_seconds(write_start);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                free_buffers.push_back(std::move(output.buffer));
+            }
+            free_condition.notify_one();
+        }
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+}
+
+
+void BatchRenderer::fail(std::exception_ptr exception)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error)
+            error = exception;
+        failed = true;
+    }
+    ready_condition.notify_all();
+    free_condition.notify_all();
+}
@@ -0,0 +1,128 @@
+#include "bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+Aabb compute_bounds(const std::vector<glm::vec3> &points)
+{
+    Aabb bounds;
+    for (const glm::vec3 &point : points)
+    {
+        bounds.expand(point);
+    }
+    return bounds;
+}
+
+
+BoundingSphere compute_bounding_sphere(const std::vector<glm::vec3> &points, const Aabb &bounds)
+{
+    if (bounds.is_empty())
+        return BoundingSphere {};
+
+    // Centered on the box, which is tighter than its circumsphere for most meshes.
+    BoundingSphere sphere { bounds.get_center(), 0.0f };
+    float radius_squared = 0.0f;
+    for (const glm::vec3 &point : points)
+    {
+        glm::vec3 offset = point - sphere.center;
+        radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+    }
+    sphere.radius = std::sqrt(radius_squared);
+    return sphere;
+}
+
+
+Aabb transform_bounds(const Aabb &bounds, const glm::mat4 &matrix)
+{
+    if (bounds.is_empty())
+        return bounds;
+
+    // Arvo: the new extent along each axis is the absolute matrix applied to the old extent.
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(bounds.get_center(), 1.0f));
+    glm::vec3 extent = bounds.get_extent();
+    glm::vec3 new_extent(0.0f);
+    for (int32_t column = 0; column < 3; column++)
+    {
+        for (int32_t row = 0; row < 3; row++)
+        {
+            new_extent[row] += std::abs(matrix[column][row]) * extent[column];
+        }
+    }
+
+    Aabb result;
+    result.min = center - new_extent;
+    result.max = center + new_extent;
+    return result;
+}
+
+
+BoundingSphere transform_bounding_sphere(const BoundingSphere &sphere, const glm::mat4 &matrix)
+{
+    float scale = std::max({glm::length(glm::vec3(matrix[0])), glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))});
+    return BoundingSphere { glm::vec3(matrix * glm::vec4(sphere.center, 1.0f)), sphere.radius * scale };
+}
+
+
+Frustum extract_frustum(const glm::mat4 &view_projection, float near_w)
+{
+    glm::vec4 row_x(view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0]);
+    glm::vec4 row_y(view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1]);
+    glm::vec4 row_w(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+
+    Frustum frustum;
+    frustum.planes[0] = row_w + row_x;
+    frustum.planes[1] = row_w - row_x;
+    frustum.planes[2] = row_w + row_y;
+    frustum.planes[3] = row_w - row_y;
+    frustum.planes[4] = row_w - glm::vec4(0.0f, 0.0f, 0.0f, near_w);
+    return frustum;
+}
+
+
+FrustumTest test_frustum(const Frustum &frustum, const Aabb &bounds, uint32_t &plane_mask)
+{
+    glm::vec3 center = bounds.get_center();
+    glm::vec3 extent = bounds.get_extent();
+
+    for (uint32_t i = 0; i < Frustum::PLANE_COUNT; i++)
+    {
+        uint32_t bit = 1 << i;
+        if (!(plane_mask & bit))
+            continue;
+
+        const glm::vec4 &plane = frustum.planes[i];
+        glm::vec3 normal(plane);
+        float distance = glm::dot(normal, center) + plane.w;
+        float radius = glm::dot(glm::abs(normal), extent);
+
+        if (distance + radius < 0.0f)
+            return FrustumTest::Outside;
+        if (distance - radius >= 0.0f)
+            plane_mask &= ~bit;
+    }
+
+    return plane_mask ? FrustumTest::Intersecting : FrustumTest::Inside;
+}
+
+
+void normalize_frustum(Frustum &frustum)
+{
+    for (glm::vec4 &plane : frustum.planes)
+    {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f)
+            plane /= length;
+    }
+}
+
+
+bool intersects_frustum(const Frustum &frustum, const BoundingSphere &sphere)
+{
+    for (const glm::vec4 &plane : frustum.planes)
+    {
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,138 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+
+void Bvh::build(const std::vector<Aabb> &bounds)
+{
+    nodes.clear();
+    leaf_bounds.clear();
+    indices.resize(bounds.size());
+    std::iota(indices.begin(), indices.end(), 0);
+
+    if (bounds.empty())
+        return;
+
+    // A binary tree with leaves of at least one box has fewer than twice as many nodes as boxes.
+    nodes.reserve(bounds.size() * 2);
+    nodes.push_back(Node { Aabb {}, 0, static_cast<uint32_t>(bounds.size()), 0 });
+    build_node(0, bounds);
+
+    leaf_bounds.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        leaf_bounds[i] = bounds[indices[i]];
+    }
+}
+
+
+void Bvh::build_node(uint32_t node, const std::vector<Aabb> &bounds)
+{
+    uint32_t first = nodes[node].first;
+    uint32_t count = nodes[node].count;
+
+    Aabb node_bounds;
+    Aabb centroid_bounds;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        node_bounds.expand(bounds[indices[i]]);
+        centroid_bounds.expand(bounds[indices[i]].get_center());
+    }
+    nodes[node].bounds = node_bounds;
+
+    if (count <= MAX_LEAF_SIZE)
+        return;
+
+    glm::vec3 size = centroid_bounds.max - centroid_bounds.min;
+    int32_t axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+    uint32_t half = count / 2;
+    std::nth_element(indices.begin() + first, indices.begin() + first + half, indices.begin() + first + count, [&](uint32_t a, uint32_t b)
+    {
+        return bounds[a].get_center()[axis] < bounds[b].get_center()[axis];
+    });
+
+    uint32_t left = static_cast<uint32_t>(nodes.size());
+    nodes[node].left = left;
+    nodes.push_back(Node { Aabb {}, first, half, 0 });
+    nodes.push_back(Node { Aabb {}, first + half, count - half, 0 });
+
+    build_node(left, bounds);
+    build_node(left + 1, bounds);
+}
+
+
+void Bvh::refit(const std::vector<Aabb> &bounds)
+{
+    // Children are always stored after their parent.
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Node &node = nodes[i];
+        node.bounds = Aabb {};
+
+        if (node.is_leaf())
+        {
+            for (uint32_t j = node.first; j < node.first + node.count; j++)
+            {
+                leaf_bounds[j] = bounds[indices[j]];
+                node.bounds.expand(leaf_bounds[j]);
+            }
+        }
+        else
+        {
+            node.bounds.expand(nodes[node.left].bounds);
+            node.bounds.expand(nodes[node.left + 1].bounds);
+        }
+    }
+}
+
+
+void Bvh::cull(const Frustum &frustum, std::vector<uint32_t> &visible) const
+{
+    if (nodes.empty())
+        return;
+
+    struct Entry
+    {
+        uint32_t node;
+        uint32_t plane_mask;
+    };
+
+    // Median splits keep the depth logarithmic, so a small fixed stack is enough.
+    Entry stack[64];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = Entry { 0, Frustum::ALL_PLANES };
+
+    while (stack_size > 0)
+    {
+        Entry entry = stack[--stack_size];
+        const Node &node = nodes[entry.node];
+
+        // Planes a parent is fully inside of are not tested again for its children.
+        uint32_t plane_mask = entry.plane_mask;
+        FrustumTest result = test_frustum(frustum, node.bounds, plane_mask);
+        if (result == FrustumTest::Outside)
+            continue;
+
+        if (result == FrustumTest::Inside)
+        {
+            visible.insert(visible.end(), indices.begin() + node.first, indices.begin() + node.first + node.count);
+            continue;
+        }
+
+        if (node.is_leaf())
+        {
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+            {
+                uint32_t leaf_mask = plane_mask;
+                if (test_frustum(frustum, leaf_bounds[i], leaf_mask) != FrustumTest::Outside)
+                    visible.push_back(indices[i]);
+            }
+            continue;
+        }
+
+        stack[stack_size++] = Entry { node.left + 1, plane_mask };
+        stack[stack_size++] = Entry { node.left, plane_mask };
+    }
+}
@@ -0,0 +1,80 @@
+#include "clipper.hpp"
+
+#include <algorithm>
+
+
+// Signed distance to a plane, positive on the inside.
+static float plane_distance(const ClipVertex &v, uint16_t plane, const ClipPlanes &planes)
+{
+    switch (plane)
+    {
+    case CLIP_NEAR:
+        return v.w - planes.near_w;
+    case CLIP_GUARD_LEFT:
+        return v.x + planes.guard_x * v.w;
+    case CLIP_GUARD_RIGHT:
+        return planes.guard_x * v.w - v.x;
+    case CLIP_GUARD_BOTTOM:
+        return v.y + planes.guard_y * v.w;
+    default:
+        return planes.guard_y * v.w - v.y;
+    }
+}
+
+
+// Sutherland-Hodgman against a single plane.
+static uint32_t clip_polygon(const ClipVertex *input, uint32_t count, uint16_t plane, const ClipPlanes &planes, ClipVertex *output)
+{
+    uint32_t output_count = 0;
+
+    const ClipVertex *previous = &input[count - 1];
+    float previous_distance = plane_distance(*previous, plane, planes);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const ClipVertex *current = &input[i];
+        float current_distance = plane_distance(*current, plane, planes);
+
+        if ((previous_distance >= 0.0f) != (current_distance >= 0.0f))
+        {
+            float t = previous_distance / (previous_distance - current_distance);
+            output[output_count++] = ClipVertex
+            {
+                previous->x + (current->x - previous->x) * t,
+                previous->y + (current->y - previous->y) * t,
+                previous->w + (current->w - previous->w) * t,
+                previous->s + (current->s - previous->s) * t,
+                previous->t + (current->t - previous->t) * t
+            };
+        }
+        if (current_distance >= 0.0f)
+            output[output_count++] = *current;
+
+        previous = current;
+        previous_distance = current_distance;
+    }
+
+    return output_count;
+}
+
+
+uint32_t clip_triangle(const ClipVertex *triangle, uint16_t clip_codes, const ClipPlanes &planes, ClipVertex *polygon)
+{
+    ClipVertex scratch[MAX_CLIP_VERTICES];
+
+    std::copy(triangle, triangle + 3, polygon);
+    uint32_t count = 3;
+
+    for (uint16_t plane : {CLIP_NEAR, CLIP_GUARD_LEFT, CLIP_GUARD_RIGHT, CLIP_GUARD_BOTTOM, CLIP_GUARD_TOP})
+    {
+        if (!(clip_codes & plane))
+            continue;
+
+        count = clip_polygon(polygon, count, plane, planes, scratch);
+        if (count < 3)
+            return 0;
+        std::copy(scratch, scratch + count, polygon);
+    }
+
+    return count;
+}
@@ -0,0 +1,61 @@
+#include "depth_format.hpp"
+
+#include <stdexcept>
+
+
+DepthFormat parse_depth_format(const std::string &name)
+{
+    if (name == "float")
+        return DepthFormat::Float32;
+    if (name == "unorm24")
+        return DepthFormat::Unorm24;
+    if (name == "unorm16")
+        return DepthFormat::Unorm16;
+    throw std::runtime_error("Unknown depth format " + name);
+}
+
+
+const char *get_depth_format_name(DepthFormat format)
+{
+    switch (format)
+    {
+    case DepthFormat::Unorm24:
+        return "unorm24";
+    case DepthFormat::Unorm16:
+        return "unorm16";
+    default:
+        return "float";
+    }
+}
+
+
+size_t get_depth_format_size(DepthFormat format)
+{
+    return dispatch_depth_format(format, [](auto traits)
+    {
+        return sizeof(typename decltype(traits)::Storage);
+    });
+}
+
+
+float encode_depth_units(DepthFormat format, float depth)
+{
+    return dispatch_depth_format(format, [depth](auto traits)
+    {
+        return static_cast<float>(decltype(traits)::encode(depth));
+    });
+}
+
+
+void decode_depth(DepthFormat format, const void *depth, size_t count, float *result)
+{
+    dispatch_depth_format(format, [&](auto traits)
+    {
+        using Format = decltype(traits);
+        const auto *stored = static_cast<const typename Format::Storage *>(depth);
+        for (size_t i = 0; i < count; i++)
+        {
+            result[i] = Format::decode(stored[i]);
+        }
+    });
+}
@@ -0,0 +1,155 @@
+#include "depth_pyramid.hpp"
+#include "span_kernels.hpp"
+
+#include <algorithm>
+
+#ifdef RASTERIZER_X86
+#include <emmintrin.h>
+#endif
+
+
+DepthPyramid::DepthPyramid(int32_t width, int32_t height, int32_t tile_size, DepthFormat format) : WIDTH(width), HEIGHT(height), TILE_SIZE(tile_size), TILE_BLOCKS(tile_size / BLOCK_SIZE), FORMAT(format)
+{
+    blocks_x = (WIDTH + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    blocks_y = (HEIGHT + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    tiles_x = (WIDTH + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (HEIGHT + TILE_SIZE - 1) / TILE_SIZE;
+
+    block_depth = std::make_unique<float[]>(blocks_x * blocks_y);
+    tile_depth = std::make_unique<float[]>(tiles_x * tiles_y);
+
+    clear();
+}
+
+
+void DepthPyramid::clear()
+{
+    std::fill(block_depth.get(), block_depth.get() + blocks_x * blocks_y, 0.0f);
+    std::fill(tile_depth.get(), tile_depth.get() + tiles_x * tiles_y, 0.0f);
+}
+
+
+#ifdef RASTERIZER_X86
+// The 8 depths of a block row as floats. Unorm values stay below 2^24 and convert exactly.
+static inline void load_block_row(const float *row, __m128 &low, __m128 &high)
+{
+    low = _mm_loadu_ps(row);
+    high = _mm_loadu_ps(row + 4);
+}
+
+
+static inline void load_block_row(const uint32_t *row, __m128 &low, __m128 &high)
+{
+    low = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row)));
+    high = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + 4)));
+}
+
+
+static inline void load_block_row(const uint16_t *row, __m128 &low, __m128 &high)
+{
+    __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row));
+    low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, _mm_setzero_si128()));
+    high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, _mm_setzero_si128()));
+}
+#endif
+
+
+template <typename Format>
+float DepthPyramid::compute_block_depth(const typename Format::Storage *depth, int32_t block_x, int32_t block_y) const
+{
+    int32_t min_x = block_x * BLOCK_SIZE;
+    int32_t min_y = block_y * BLOCK_SIZE;
+    int32_t max_x = std::min(min_x + BLOCK_SIZE, WIDTH);
+    int32_t max_y = std::min(min_y + BLOCK_SIZE, HEIGHT);
+
+#ifdef RASTERIZER_X86
+    if (max_x - min_x == BLOCK_SIZE)
+    {
+        __m128 farthest = _mm_set1_ps(static_cast<float>(depth[static_cast<size_t>(min_y) * WIDTH + min_x]));
+        for (int32_t y = min_y; y < max_y; y++)
+        {
+            __m128 low;
+            __m128 high;
+            load_block_row(depth + static_cast<size_t>(y) * WIDTH + min_x, low, high);
+            farthest = _mm_min_ps(farthest, _mm_min_ps(low, high));
+        }
+        farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+        farthest = _mm_min_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(farthest);
+    }
+#endif
+
+    auto farthest = depth[static_cast<size_t>(min_y) * WIDTH + min_x];
+    for (int32_t y = min_y; y < max_y; y++)
+    {
+        const auto *row = depth + static_cast<size_t>(y) * WIDTH;
+        for (int32_t x = min_x; x < max_x; x++)
+        {
+            farthest = std::min(farthest, row[x]);
+        }
+    }
+    return static_cast<float>(farthest);
+}
+
+
+void DepthPyramid::update(const void *depth, int32_t min_x, int32_t min_y, int32_t max_x, int32_t max_y)
+{
+    dispatch_depth_format(FORMAT, [&](auto traits)
+    {
+        using Format = decltype(traits);
+        const auto *stored = static_cast<const typename Format::Storage *>(depth);
+        for (int32_t block_y = min_y / BLOCK_SIZE; block_y <= max_y / BLOCK_SIZE; block_y++)
+        {
+            for (int32_t block_x = min_x / BLOCK_SIZE; block_x <= max_x / BLOCK_SIZE; block_x++)
+            {
+                block_depth[block_y * blocks_x + block_x] = compute_block_depth<Format>(stored, block_x, block_y);
+            }
+        }
+    });
+
+    int32_t tile_x = min_x / TILE_SIZE;
+    int32_t tile_y = min_y / TILE_SIZE;
+    int32_t first_x = tile_x * TILE_BLOCKS;
+    int32_t first_y = tile_y * TILE_BLOCKS;
+    int32_t last_x = std::min(first_x + TILE_BLOCKS, blocks_x);
+    int32_t last_y = std::min(first_y + TILE_BLOCKS, blocks_y);
+
+    float farthest = block_depth[first_y * blocks_x + first_x];
+    for (int32_t block_y = first_y; block_y < last_y; block_y++)
+    {
+        for (int32_t block_x = first_x; block_x < last_x; block_x++)
+        {
+            farthest = std::min(farthest, block_depth[block_y * blocks_x + block_x]);
+        }
+    }
+    tile_depth[tile_y * tiles_x + tile_x] = farthest;
+}
+
+
+bool DepthPyramid::is_occluded(int32_t min_x, int32_t min_y, int32_t max_x, int32_t max_y, float nearest_depth) const
+{
+    for (int32_t tile_y = min_y / TILE_SIZE; tile_y <= max_y / TILE_SIZE; tile_y++)
+    {
+        for (int32_t tile_x = min_x / TILE_SIZE; tile_x <= max_x / TILE_SIZE; tile_x++)
+        {
+            // Depth test passes only for strictly closer values, so equal counts as hidden.
+            if (nearest_depth <= tile_depth[tile_y * tiles_x + tile_x])
+                continue;
+
+            int32_t block_min_x = std::max(min_x, tile_x * TILE_SIZE) / BLOCK_SIZE;
+            int32_t block_min_y = std::max(min_y, tile_y * TILE_SIZE) / BLOCK_SIZE;
+            int32_t block_max_x = std::min(max_x, tile_x * TILE_SIZE + TILE_SIZE - 1) / BLOCK_SIZE;
+            int32_t block_max_y = std::min(max_y, tile_y * TILE_SIZE + TILE_SIZE - 1) / BLOCK_SIZE;
+
+            for (int32_t block_y = block_min_y; block_y <= block_max_y; block_y++)
+            {
+                for (int32_t block_x = block_min_x; block_x <= block_max_x; block_x++)
+                {
+                    if (nearest_depth > block_depth[block_y * blocks_x + block_x])
+                        return false;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,107 @@
+#include "frame_pipeline.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+
+FramePipeline::FramePipeline(Renderer &_renderer, uint32_t frames_in_flight, std::function<void()> _render_frame) : renderer(_renderer), FRAMES_IN_FLIGHT(std::max(frames_in_flight, 1u)), render_frame(std::move(_render_frame))
+{
+    // Besides the one inside the renderer: one with the caller and one per queued frame.
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT + 1; i++)
+    {
+        free_buffers.push_back(renderer.create_color_buffer());
+    }
+
+    render_thread = std::thread(&FramePipeline::render_loop, this);
+}
+
+
+FramePipeline::~FramePipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    free_condition.notify_all();
+    render_thread.join();
+}
+
+
+const uint8_t *FramePipeline::acquire_frame()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    ready_condition.wait(lock, [this] { return !ready_buffers.empty() || error; });
+    if (ready_buffers.empty())
+        std::rethrow_exception(error);
+
+    if (presented.pixels)
+        free_buffers.push_back(std::move(presented));
+    presented = std::move(ready_buffers.front());
+    ready_buffers.pop_front();
+    lock.unlock();
+
+    free_condition.notify_one();
+    return presented.pixels.get();
+}
+
+
+void FramePipeline::pause()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    pause_requested = true;
+    parked_condition.wait(lock, [this] { return parked || error; });
+}
+
+
+void FramePipeline::resume()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pause_requested = false;
+    }
+    free_condition.notify_one();
+}
+
+
+void FramePipeline::render_loop()
+{
+    try
+    {
+        while (true)
+        {
+            render_frame();
+
+            ColorBuffer buffer;
+            {
+                PROFILE_SCOPE("wait_for_present");
+                std::unique_lock<std::mutex> lock(mutex);
+                parked = true;
+                parked_condition.notify_all();
+                free_condition.wait(lock, [this] { return stopping || (!pause_requested && !free_buffers.empty() && ready_buffers.size() < FRAMES_IN_FLIGHT); });
+                parked = false;
+                if (stopping)
+                    return;
+                buffer = std::move(free_buffers.back());
+                free_buffers.pop_back();
+            }
+
+            // Hands the finished frame out and continues into the buffer that was free.
+            renderer.swap_color_buffer(buffer);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready_buffers.push_back(std::move(buffer));
+            }
+            ready_condition.notify_one();
+        }
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+        }
+        ready_condition.notify_one();
+        parked_condition.notify_all();
+    }
+}
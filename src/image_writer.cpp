@@ -0,0 +1,85 @@
+#include "image_writer.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+
+static void write_ppm(const std::filesystem::path &path, const uint8_t *pixels, int32_t width, int32_t height)
+{
+    std::ofstream out_file(path, std::ios::binary);
+    if (!out_file.is_open())
+    {
+        throw std::runtime_error("Can't write image file " + path.string());
+    }
+
+    out_file << "P6\n" << width << " " << height << "\n255\n";
+
+    std::unique_ptr<uint8_t[]> row = std::make_unique<uint8_t[]>(width * 3);
+    for (int32_t y = 0; y < height; y++)
+    {
+        const uint8_t *src = pixels + static_cast<size_t>(y) * width * 4;
+        for (int32_t x = 0; x < width; x++)
+        {
+            row[x * 3] = src[x * 4];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        out_file.write(reinterpret_cast<const char *>(row.get()), width * 3);
+    }
+}
+
+
+void save_color_buffer(const std::filesystem::path &path, const uint8_t *pixels, int32_t width, int32_t height)
+{
+    if (path.extension() == ".ppm")
+    {
+        write_ppm(path, pixels, width, height);
+        return;
+    }
+
+    sf::Image image;
+    image.create(sf::Vector2u(width, height), pixels);
+    if (!image.saveToFile(path))
+    {
+        throw std::runtime_error("Can't write image file " + path.string());
+    }
+}
+
+
+void save_depth_buffer(const std::filesystem::path &path, const float *depth_buffer, int32_t width, int32_t height)
+{
+    size_t size = static_cast<size_t>(width) * height;
+
+    float min_depth = std::numeric_limits<float>::max();
+    float max_depth = 0.0f;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (depth_buffer[i] > 0.0f)
+        {
+            min_depth = std::min(min_depth, depth_buffer[i]);
+            max_depth = std::max(max_depth, depth_buffer[i]);
+        }
+    }
+    float range = max_depth > min_depth ? max_depth - min_depth : 1.0f;
+
+    std::unique_ptr<uint8_t[]> gray = std::make_unique<uint8_t[]>(size * 4);
+    for (size_t i = 0; i < size; i++)
+    {
+        uint8_t value = 0;
+        if (depth_buffer[i] > 0.0f)
+        {
+            value = static_cast<uint8_t>(32.0f + 223.0f * (depth_buffer[i] - min_depth) / range);
+        }
+        gray[i * 4] = value;
+        gray[i * 4 + 1] = value;
+        gray[i * 4 + 2] = value;
+        gray[i * 4 + 3] = 255;
+    }
+
+    save_color_buffer(path, gray.get(), width, height);
+}
@@ -13,6 +13,17 @@
 #include <cmath>
 #include <fstream>
 #include <filesystem>
+#include <string>
+#include <algorithm>
+
+#include "model.hpp"
+#include "obj_parser.hpp"
+#include "renderer.hpp"
+#include "scenes.hpp"
+#include "image_writer.hpp"
+#include "profiler.hpp"
+#include "frame_pipeline.hpp"
+#include "batch_renderer.hpp"
 
 
 const std::string WINDOW_NAME = "Rasterizer";
@@ -20,202 +31,11 @@ const int32_t WIDTH = 800;
 const int32_t HEIGHT = 800;
 
 
-struct Model 
-{
-    std::string name;
-    std::vector<glm::vec3> vertices;
-    std::vector<std::pair<std::vector<int32_t>, sf::Color>> triangles;
-};
-
-
-const Model cube {
-    "Cube", 
-    {
-        { 1.0f,  1.0f,  1.0f }, {-1.0f,  1.0f,  1.0f }, {-1.0f, -1.0f,  1.0f }, { 1.0f, -1.0f,  1.0f },
-        { 1.0f,  1.0f, -1.0f }, {-1.0f,  1.0f, -1.0f }, {-1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }
-    },
-    {
-        {{0, 1, 2}, sf::Color::Blue},
-        {{0, 2, 3}, sf::Color::Blue},
-
-        {{4, 0, 3}, sf::Color::Red},
-        {{4, 3, 7}, sf::Color::Red},
-
-        {{5, 4, 7}, sf::Color::Green},
-        {{5, 7, 6}, sf::Color::Green},
-
-        {{1, 5, 6}, sf::Color::Yellow},
-        {{1, 6, 2}, sf::Color::Yellow},
-
-        {{4, 5, 1}, sf::Color::Cyan},
-        {{4, 1, 0}, sf::Color::Cyan},
-
-        {{2, 6, 7}, sf::Color::Magenta},
-        {{2, 7, 3}, sf::Color::Magenta}
-    }
-};
-
-
-struct ModelTransform
-{
-    glm::mat4 scale;
-    glm::mat4 rotate;
-    glm::mat4 translate;
-
-    glm::mat4 model;
-
-    ModelTransform() { scale = glm::mat4(0.0f); rotate = glm::mat4(0.0f); translate = glm::mat4(0.0f); }
-
-    ModelTransform(glm::vec3 _scale, glm::vec3 _rotate, float _angle, glm::vec3 _translate)
-    {
-        glm::mat4 t(1.0f);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, _translate);
-        model = glm::rotate(model, glm::radians(_angle), _rotate);
-        model = glm::scale(model, _scale);
-    }
-};
-
-
-struct ModelInstance 
-{
-    Model model;
-    ModelTransform transform;
-    std::vector<glm::vec4> vertices;
-
-    ModelInstance(Model _model, glm::vec3 _scale, glm::vec3 _rotate, float _angle, glm::vec3 _translate) : model(_model)
-    {
-        transform = ModelTransform(_scale, _rotate, _angle, _translate);
-        update_vertices();
-    }
-
-
-    void update_vertices()
-    {
-        for (auto &vertex : model.vertices)
-        {
-            glm::vec4 result_vertex = glm::vec4(vertex, 1.0f);
-            result_vertex = transform.model * result_vertex;
-
-            vertices.push_back(result_vertex);
-        }
-    }
-};
-
-
-struct Scene
-{
-    std::vector<ModelInstance> instances;
-};
-
-
-class Camera
-{
-public:
-    glm::vec3 position;
-    glm::vec3 rotate;
-    float angle;
-    glm::mat4 view;
-
-    Camera(glm::vec3 _position, glm::vec3 _rotate, float _angle) : position(_position), rotate(_rotate), angle(_angle)
-    {
-        update_transform();
-    }
-
-    void update_transform()
-    {
-        // glm::mat4 camera_rotate = glm::inverse(glm::rotate(glm::radians(angle), rotate));
-        // glm::mat4 camera_translate = glm::translate(position);
-        
-        view = glm::mat4(1.0f);
-        view = glm::translate(view, position);
-        view = glm::inverse(glm::rotate(view, glm::radians(angle), rotate));
-    }
-};
-
-
-std::vector<std::pair<std::vector<int32_t>, sf::Color>> trises = {
-    {{0, 1, 2}, sf::Color::Blue},
-    {{0, 2, 3}, sf::Color::Blue},
-
-    {{4, 0, 3}, sf::Color::Red},
-    {{4, 3, 7}, sf::Color::Red},
-
-    {{5, 4, 7}, sf::Color::Green},
-    {{5, 7, 6}, sf::Color::Green},
-
-    {{1, 5, 6}, sf::Color::Yellow},
-    {{1, 6, 2}, sf::Color::Yellow},
-
-    {{4, 5, 1}, sf::Color::Cyan},
-    {{4, 1, 0}, sf::Color::Cyan},
-
-    {{2, 6, 7}, sf::Color::Magenta},
-    {{2, 7, 3}, sf::Color::Magenta}
-};
-
-
-std::pair<std::vector<glm::vec3>, std::vector<std::vector<int32_t>>> parse_obj(std::string path)
-{
-    std::ifstream in_file(path);
-    std::string line;
-    std::vector<glm::vec3> vertices;
-    std::vector<std::vector<int32_t>> faces;
-    if (!in_file.is_open())
-    {
-        throw std::runtime_error("Can't read obj file");
-    }
-    
-    while (std::getline(in_file, line))
-    {
-        if (line[0] == 'v' && line[1] == ' ')
-        {
-            std::string str_to_parse = line.substr(2, line.size() - 2);
-            float x = std::stof(str_to_parse.substr(0, str_to_parse.find(' ')));
-            str_to_parse = str_to_parse.substr(str_to_parse.find(' ')).erase(0, 1);
-            float y = std::stof(str_to_parse.substr(0, str_to_parse.find(' ')));
-            str_to_parse = str_to_parse.substr(str_to_parse.find(' ')).erase(0, 1);
-            float z = std::stof(str_to_parse);
-
-            glm::vec3 result_vertice(x, y, z);
-            vertices.push_back(result_vertice);
-        }
-
-        if (line[0] == 'f')
-        {
-            std::string str_to_parse = line.substr(2, line.size() - 2);
-            std::string t_str = str_to_parse.substr(0, str_to_parse.find(' '));
-            int32_t v1 = std::stoi(t_str.substr(0, t_str.find('/'))) - 1;
-
-            str_to_parse = str_to_parse.substr(str_to_parse.find(' ')).erase(0, 1);
-            t_str = str_to_parse.substr(0, str_to_parse.find(' '));
-            int32_t v2 = std::stoi(t_str.substr(0, t_str.find('/'))) - 1;
-
-            str_to_parse = str_to_parse.substr(str_to_parse.find(' ')).erase(0, 1);
-            int32_t v3 = std::stoi(str_to_parse.substr(0, str_to_parse.find('/'))) - 1;
-
-            std::vector<int32_t> result_face = {v1, v2, v3};
-            faces.push_back(result_face);
-        }
-    }
-    in_file.close();
-
-    std::pair<std::vector<glm::vec3>, std::vector<std::vector<int32_t>>> result(vertices, faces);
-
-    return result;
-}
-
-
 class RaytracerApp
 {
 public:
-    RaytracerApp(std::string window_name, int32_t width, int32_t height) : WINDOW_NAME(window_name), WIDTH(width), HEIGHT(height), WINDOW_SIZE(sf::Vector2u(WIDTH, HEIGHT)), window(sf::RenderWindow(sf::VideoMode(WINDOW_SIZE), WINDOW_NAME)) 
+    RaytracerApp(std::string window_name, int32_t width, int32_t height, std::string _trace_path, uint32_t _frames_in_flight) : WINDOW_NAME(window_name), WIDTH(width), HEIGHT(height), WINDOW_SIZE(sf::Vector2u(WIDTH, HEIGHT)), window(sf::RenderWindow(sf::VideoMode(WINDOW_SIZE), WINDOW_NAME)), renderer(WIDTH, HEIGHT), trace_path(_trace_path), frames_in_flight(_frames_in_flight)
     {
-        pixels = std::make_unique<uint8_t[]>(WIDTH * HEIGHT * 4);
-        depth_buffer = std::make_unique<float[]>(WIDTH * HEIGHT);
-
-        clear_depth_buffer();
-        
         if (!texture.create(WINDOW_SIZE))
             throw std::runtime_error("Failed to create texture.");
         sprite = sf::Sprite(texture);
@@ -237,13 +57,12 @@ private:
     const sf::Vector2u WINDOW_SIZE;
     sf::RenderWindow window;
 
-    std::unique_ptr<uint8_t[]> pixels;
+    Renderer renderer;
     sf::Texture texture;
     sf::Sprite sprite;
-    
-    std::unique_ptr<float[]> depth_buffer;
 
-    sf::Clock clock;
+    std::string trace_path;
+    uint32_t frames_in_flight;
 
     glm::vec3 camera_pos = glm::vec3(0.0f, 0.0f, -1.0f);
     glm::vec3 camera_rotation = glm::vec3(0.0f, 1.0f, 0.0f);
@@ -251,452 +70,352 @@ private:
 
     Camera camera {camera_pos, camera_rotation, camera_angle};
 
-    float d = 1.0f;
-    int32_t viewport_width = 1;
-    int32_t viewport_height = 1;
-
     Scene scene {};
 
 
     void main_loop()
     {
-        std::vector<glm::vec3> vertices;
-        std::vector<std::vector<int32_t>> faces;
+        // P prints the profile summary, T writes a Chrome trace of the frames still held in the ring buffers. Both pause
+        // the pipeline, the exports read buffers that the render thread and its pool write while a frame is rendered.
+        Profiler &profiler = Profiler::get();
+        profiler.set_enabled(true);
 
-        std::tie(vertices, faces) = parse_obj("../../obj/head.obj");
+        // The next frames render while this one is uploaded and waits for display, scene and camera belong to the render thread.
+        FramePipeline pipeline(renderer, frames_in_flight, [this]
+        {
+            renderer.clear(sf::Color::Black);
+            renderer.render_scene(scene, camera);
+        });
 
         while (window.isOpen())
         {
-            float current_time = clock.restart().asSeconds();
-            float fps = 1.0f / (current_time);
-
-            std::cout << "frametime: " << current_time << ", fps: " << fps << "\n";
+            PROFILE_SCOPE("frame");
 
-            fill(sf::Color::Black);
+            const uint8_t *frame = pipeline.acquire_frame();
 
-            // draw_filled_triangle(glm::vec2(-400, -400), glm::vec2(399, -400), glm::vec2(0, 0), 1.0f, 1.0f, 1.0f, sf::Color::White);
-            // draw_triangle(glm::vec2(-400, -400), glm::vec2(399, -400), glm::vec2(0, 0), 1.0f, 1.0f, 1.0f, sf::Color::White);
-
-            render_scene();
-            
-            texture.update(pixels.get());
-
-            clear_depth_buffer();
+            {
+                PROFILE_SCOPE("texture.update");
+                texture.update(frame);
+            }
 
-            sf::Event event;
-            while (window.pollEvent(event))
             {
-                if (event.type == sf::Event::Closed)
-                    window.close();
-                if (event.type == sf::Event::KeyPressed)
+                PROFILE_SCOPE("poll_events");
+                sf::Event event;
+                while (window.pollEvent(event))
                 {
-                    if (event.key.code == sf::Keyboard::Escape)
-                    {
+                    if (event.type == sf::Event::Closed)
                         window.close();
+                    if (event.type == sf::Event::KeyPressed)
+                    {
+                        if (event.key.code == sf::Keyboard::Escape)
+                        {
+                            window.close();
+                        }
+                        else if (event.key.code == sf::Keyboard::P)
+                        {
+                            pipeline.pause();
+                            profiler.write_summary(std::cout);
+                            pipeline.resume();
+                        }
+                        else if (event.key.code == sf::Keyboard::T)
+                        {
+                            pipeline.pause();
+                            profiler.write_chrome_trace(trace_path);
+                            pipeline.resume();
+                            std::cout << "trace written to " << trace_path << "\n";
+                        }
                     }
                 }
             }
 
+            PROFILE_SCOPE("present");
             window.clear();
             window.draw(sprite);
             window.display();
         }
     }
 
-    
-    void put_pixel(int32_t x, int32_t y, float depth, const sf::Color &color)
+
+    void create_scene()
     {
-        if (x > (WIDTH - 1) / 2 || x < -WIDTH / 2 || y > (HEIGHT - 1) / 2 || y < -HEIGHT / 2)
-        {
-            return;
-            // throw std::runtime_error("Failed to put pixel.");
-        }
-        uint32_t fixed_x = WIDTH / 2 + x;
-        uint32_t fixed_y = (HEIGHT + 1) / 2 - (y + 1);
+        scene = create_cubes_scene();
+    }
+};
 
-        if (depth_buffer[fixed_y * WIDTH + fixed_x] < depth)
-        {
-            pixels[fixed_y * (WIDTH * 4) + (fixed_x * 4)] = color.r;
-            pixels[fixed_y * (WIDTH * 4) + (fixed_x * 4) + 1] = color.g;
-            pixels[fixed_y * (WIDTH * 4) + (fixed_x * 4) + 2] = color.b;
-            pixels[fixed_y * (WIDTH * 4) + (fixed_x * 4) + 3] = 255;
 
-            depth_buffer[fixed_y * WIDTH + fixed_x] = depth;
-        }
-    }
+struct HeadlessOptions
+{
+    int32_t width = WIDTH;
+    int32_t height = HEIGHT;
+    int32_t frames = 100;
+    uint32_t threads = 0;
+    std::string kernel = "auto";
+    std::string depth_format = "float";
+    std::string scene = "cubes";
+    std::string texture;
+    std::string output;
+    std::string depth_output;
+    std::string obj_benchmark;
+    size_t synthetic_megabytes = 64;
+    bool occluder_pass = true;
+    bool lod_selection = true;
+    bool visibility_buffer = false;
+    uint32_t samples = 1;
+    int32_t field_size = 100;
+    bool profile = false;
+    std::string trace_path = "rasterizer_trace.json";
+    uint32_t frames_in_flight = 2;
+    // Batch runs render a script or a turntable of turntable_frames frames, threads is then per worker.
+    std::string batch_script;
+    uint32_t turntable_frames = 0;
+    uint32_t workers = 0;
+    uint32_t writers = 0;
+};
 
 
-    void clear_depth_buffer()
+class HeadlessApp
+{
+public:
+    HeadlessApp(const HeadlessOptions &_options) : options(_options), renderer(options.width, options.height, options.threads, parse_depth_format(options.depth_format))
     {
-        std::fill(depth_buffer.get(), depth_buffer.get() + WIDTH * HEIGHT, 0.0f);
-        // for (int32_t i = 0; i < WIDTH * HEIGHT; i++)
-        // {
-        //     depth_buffer[i] = 0.0f;
-        // }
+        renderer.set_span_kernels(parse_span_kernel_isa(options.kernel));
+        renderer.set_occluder_pass(options.occluder_pass);
+        renderer.set_lod_selection(options.lod_selection);
+        renderer.set_visibility_buffer(options.visibility_buffer);
+        renderer.set_sample_count(options.samples);
+
+        sf::Clock clock;
+        scene = create_scene_by_name(options.scene, options.field_size, options.texture);
+        scene_load_time = clock.getElapsedTime().asSeconds();
     }
 
 
-    void fill(const sf::Color &color)
+    void run()
     {
-        for (size_t i = 0; i < WIDTH * HEIGHT * 4; i+=4)
+        std::vector<float> frame_times;
+        frame_times.reserve(options.frames);
+
+        sf::Clock clock;
+        for (int32_t i = 0; i < options.frames; i++)
         {
-            pixels[i] = color.r;
-            pixels[i + 1] = color.g;
-            pixels[i + 2] = color.b;
-            pixels[i + 3] = 255;
-        }
-    }
+            PROFILE_SCOPE("frame");
+            clock.restart();
 
+            renderer.clear(sf::Color::Black);
+            renderer.render_scene(scene, camera);
 
-    int clamp(int32_t value, int32_t lowest, int32_t highest)
-    {
-        if (value > highest)
-        {
-            return highest;
-        }
-        if (value < lowest)
-        {
-            return lowest;
+            frame_times.push_back(clock.getElapsedTime().asSeconds());
         }
-        return value;
-    }
 
+        report(frame_times);
 
-    std::vector<glm::vec2> interpolate(float x0, float y0, float x1, float y1)
-    {
-        if (y0 > y1)
-        {
-            throw "Wrong order";
-        }
-        std::vector<glm::vec2> result;
-        if (y0 == y1)
+        if (options.profile)
         {
-            result.push_back(glm::vec2(x0, y0));
-            return result;
+            Profiler::get().write_summary(std::cout);
+            Profiler::get().write_chrome_trace(options.trace_path);
         }
 
-        float coef = (x1 - x0) / (y1 - y0);
-       
-        int32_t y_start = static_cast<int32_t>(y0);
-        int32_t y_end = static_cast<int32_t>(y1);
-        
-        for (int32_t y = y_start; y <= y_end; y++)
+        if (!options.output.empty())
+            save_color_buffer(options.output, renderer.get_pixels(), renderer.get_width(), renderer.get_height());
+        if (!options.depth_output.empty())
         {
-            result.push_back(glm::vec2(x1 + (y - y1) * coef, y));
+            std::vector<float> depth;
+            renderer.read_depth(depth);
+            save_depth_buffer(options.depth_output, depth.data(), renderer.get_width(), renderer.get_height());
         }
-        
-        return result;
     }
 
 
-    void draw_line(const glm::vec2 &point0, const glm::vec2 &point1, float d0, float d1, const sf::Color &color)
-    {
-        int32_t x0 = static_cast<int32_t>(std::roundf(point0.x));
-        int32_t y0 = static_cast<int32_t>(std::roundf(point0.y));
-        int32_t x1 = static_cast<int32_t>(std::roundf(point1.x));
-        int32_t y1 = static_cast<int32_t>(std::roundf(point1.y));
-        
-        int32_t delta_x = std::abs(x1 - x0);
-        int32_t delta_y = std::abs(y1 - y0);
-        bool steep = false;
-        if (delta_y > delta_x)
-        {
-            std::swap(x0, y0);
-            std::swap(x1, y1);
-            std::swap(delta_x, delta_y);
-            steep = true;
-        }
-    
-        if (x0 > x1)
-        {
-            std::swap(x0, x1);
-            std::swap(y0, y1);
-            std::swap(d0, d1);
-        }
-
-        int32_t error = 0;
-        int32_t delta_error = delta_y + 1;
-
-        int32_t y = y0;
+private:
+    HeadlessOptions options;
+    Renderer renderer;
+    Scene scene {};
+    float scene_load_time = 0.0f;
 
-        int32_t dir_y = y1 - y0;
-        if (dir_y > 0)
-            dir_y = 1;
-        else if (dir_y < 0)
-            dir_y = -1;
+    Camera camera {glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f};
 
-        std::vector<glm::vec2> depth = interpolate(d0, static_cast<float>(x0), d1, static_cast<float>(x1));
 
-        int i = 0;
-        for (int32_t x = x0; x <= x1; x++)
-        {
-            if (steep)
-                put_pixel(y, x, depth[i].x, color);
-            else
-                put_pixel(x, y, depth[i].x, color);
-            
-            error += delta_error;
-            if (error >= (delta_x + 1))
-            {
-                y += dir_y;
-                error = error - (delta_x + 1);
-            }
+    void report(std::vector<float> frame_times)
+    {
+        if (frame_times.empty())
+            return;
 
-            i++;
-        }
+        float total = 0.0f;
+        for (float time : frame_times)
+            total += time;
+
+        std::sort(frame_times.begin(), frame_times.end());
+        float average = total / frame_times.size();
+
+        std::cout << "scene: " << options.scene << ", " << options.width << "x" << options.height << ", threads: " << renderer.get_thread_count() << ", kernels: " << renderer.get_span_kernels_name() << ", depth: " << get_depth_format_name(renderer.get_depth_format()) << ", samples: " << renderer.get_sample_count() << ", frames: " << frame_times.size() << "\n";
+        std::cout << "scene load: " << scene_load_time * 1000.0f << " ms\n";
+        std::cout << "frametime avg: " << average * 1000.0f << " ms, min: " << frame_times.front() * 1000.0f << " ms, median: " << frame_times[frame_times.size() / 2] * 1000.0f << " ms, max: " << frame_times.back() * 1000.0f << " ms\n";
+        std::cout << "fps: " << 1.0f / average << ", total: " << total << " s\n";
+
+        PrimitiveStats stats = renderer.get_primitive_stats();
+        std::cout << "instances: " << stats.instances << ", frustum culled: " << stats.instances_culled << ", occluded: " << stats.instances_occluded << ", reduced lod: " << stats.instances_reduced_lod << "\n";
+        std::cout << "meshlets: " << stats.meshlets << ", frustum culled: " << stats.meshlets_frustum_culled << ", backface culled: " << stats.meshlets_backface_culled << "\n";
+        std::cout << "triangles: " << stats.submitted << ", frustum culled: " << stats.frustum_culled << ", backface culled: " << stats.backface_culled << ", clipped: " << stats.clipped << ", rasterized: " << stats.rasterized << "\n";
+        std::cout << "tile triangles: " << stats.tile_triangles << ", occluded: " << stats.tile_triangles_occluded << "\n";
+        std::cout << "fragments: " << stats.fragments << ", shaded: " << stats.shaded << ", depth rejected: " << stats.fragments - stats.shaded << "\n";
+        if (stats.lights > 0)
+            std::cout << "lights: " << stats.lights << " in view, " << static_cast<double>(stats.tile_lights) / static_cast<double>(std::max<uint64_t>(stats.lit_tiles, 1)) << " per lit tile\n";
+        if (renderer.get_visibility_buffer())
+            std::cout << "visibility buffer resolved: " << stats.resolved << " pixels in " << renderer.get_frame_timings().resolve_ms << " ms\n";
     }
+};
 
 
-    void draw_triangle(const glm::vec2 &point0, const glm::vec2 &point1, const glm::vec2 &point2, float d0, float d1, float d2, const sf::Color &color)
+class BatchApp
+{
+public:
+    BatchApp(const HeadlessOptions &_options) : options(_options), script(options.batch_script.empty() ? create_turntable_script(options.turntable_frames) : load_animation_script(options.batch_script)),
+        batch(options.width, options.height, options.workers, options.threads, options.writers, parse_depth_format(options.depth_format), [this](Renderer &renderer) { configure_renderer(renderer); }, [this] { return create_scene_by_name(options.scene, options.field_size, options.texture); })
     {
-        draw_line(point0, point1, d0, d1, color);
-        draw_line(point1, point2, d1, d2, color);
-        draw_line(point2, point0, d2, d0, color);
     }
 
 
-    void draw_filled_triangle(glm::vec2 v0, glm::vec2 v1, glm::vec2 v2, float d0, float d1, float d2, const sf::Color &color)
+    void run()
     {
-        if (v1.y < v0.y)
-        { 
-            std::swap(v1, v0);
-            std::swap(d1, d0);
-        }
-        if (v2.y < v0.y)
-        {
-            std::swap(v2, v0);
-            std::swap(d2, d0);
-        }
-        if (v2.y < v1.y)
-        {
-            std::swap(v2, v1);
-            std::swap(d2, d1);
-        }
-        
-        std::vector<glm::vec2> x01 = interpolate(v0.x, v0.y, v1.x, v1.y);
-        x01.pop_back();
-        std::vector<glm::vec2> x12 = interpolate(v1.x, v1.y, v2.x, v2.y);
-        std::vector<glm::vec2> x02 = interpolate(v0.x, v0.y, v2.x, v2.y);
-            
-        std::vector<glm::vec2> x012 = x01;
-        x012.insert(x012.end(), x12.begin(), x12.end());
-
-        std::vector<glm::vec2> d01 = interpolate(d0, v0.y, d1, v1.y);
-        d01.pop_back();
-        std::vector<glm::vec2> d12 = interpolate(d1, v1.y, d2, v2.y);
-        std::vector<glm::vec2> d02 = interpolate(d0, v0.y, d2, v2.y);
-            
-        std::vector<glm::vec2> d012 = d01;
-        d012.insert(d012.end(), d12.begin(), d12.end());
-                        
-        for (int32_t i = 0; i < x02.size(); i++)
-        {
-            draw_line(x02[i], x012[i], d02[i].x, d012[i].x, color);
-        }
-        
-        // draw_triangle(v0, v1, v2, d0, d1, d2, color);
-    }
+        BatchStats stats = batch.run(script, options.output);
 
+        const Renderer &renderer = batch.get_renderer();
+        std::cout << "batch: " << options.scene << ", " << options.width << "x" << options.height << ", workers: " << batch.get_worker_count() << " x " << renderer.get_thread_count() << " threads, writers: " << (options.output.empty() ? 0 : batch.get_writer_count()) << ", kernels: " << renderer.get_span_kernels_name() << ", depth: " << get_depth_format_name(renderer.get_depth_format()) << ", samples: " << renderer.get_sample_count() << ", frames: " << stats.frames << "\n";
+        std::cout << "wall: " << stats.wall_seconds << " s, frames/hour: " << stats.frames * 3600.0 / stats.wall_seconds << ", render per frame: " << stats.render_seconds * 1000.0 / stats.frames << " ms\n";
+        std::cout << "summed over threads, render: " << stats.render_seconds << " s, waiting for writers: " << stats.stall_seconds << " s, writing: " << stats.write_seconds << " s\n";
 
-    void draw_shaded_line(const glm::vec2 &point0, const glm::vec2 &point1, float d0, float d1, float h0, float h1, const sf::Color &color)
-    {
-        float x0 = point0.x;
-        float y0 = point0.y;
-        float x1 = point1.x;
-        float y1 = point1.y;
-        
-        float delta_x = std::abs(x1 - x0);
-        float delta_y = std::abs(y1 - y0);
-        bool steep = false;
-        if (delta_y > delta_x)
+        if (options.profile)
         {
-            std::swap(x0, y0);
-            std::swap(x1, y1);
-            std::swap(delta_x, delta_y);
-            steep = true;
+            Profiler::get().write_summary(std::cout);
+            Profiler::get().write_chrome_trace(options.trace_path);
         }
+    }
 
-    
-        if (x0 > x1)
-        {
-            std::swap(x0, x1);
-            std::swap(y0, y1);
-            std::swap(d0, d1);
-            std::swap(h0, h1);
-        }
 
-        std::vector<glm::vec2> depth = interpolate(d0, x0, d1, x1);
-        std::vector<glm::vec2> points = interpolate(y0, x0, y1, x1);
-        std::vector<glm::vec2> h = interpolate(h0, x0, h1, x1);
+private:
+    HeadlessOptions options;
+    AnimationScript script;
+    BatchRenderer batch;
 
 
-        for (int32_t i = 0; i < points.size(); i++)
-        {
-            sf::Color local_color;
-            local_color.r = static_cast<uint8_t>(clamp(static_cast<int>(static_cast<float>(color.r) * h[i].x), 0, 255));
-            local_color.g = static_cast<uint8_t>(clamp(static_cast<int>(static_cast<float>(color.g) * h[i].x), 0, 255));
-            local_color.b = static_cast<uint8_t>(clamp(static_cast<int>(static_cast<float>(color.b) * h[i].x), 0, 255));
-            if (steep)
-                put_pixel(static_cast<int32_t>(points[i].x), static_cast<int32_t>(points[i].y), depth[i].x, local_color);
-            else
-                put_pixel(static_cast<int32_t>(points[i].y), static_cast<int32_t>(points[i].x), depth[i].x, local_color);
-        }
+    void configure_renderer(Renderer &renderer)
+    {
+        renderer.set_span_kernels(parse_span_kernel_isa(options.kernel));
+        renderer.set_occluder_pass(options.occluder_pass);
+        renderer.set_lod_selection(options.lod_selection);
+        renderer.set_visibility_buffer(options.visibility_buffer);
+        renderer.set_sample_count(options.samples);
     }
+};
 
-    
-    void draw_shaded_triangle(std::vector<glm::vec2> triangle, std::vector<float> depth, std::vector<float> brightness, const sf::Color &color)
-    {
-        if (triangle.size() != 3)
-        {
-            throw "Wrong size of triangle";
-        }
 
-        draw_shaded_line(triangle[0], triangle[1], depth[0], depth[1], brightness[0], brightness[1], color);
-        draw_shaded_line(triangle[0], triangle[2], depth[0], depth[2], brightness[0], brightness[2], color);
-        draw_shaded_line(triangle[1], triangle[2], depth[1], depth[2], brightness[1], brightness[2], color);
-    }
+static void print_usage()
+{
+    std::cout << "usage: rasterizer [--headless] [--frames N] [--threads N] [--kernel auto|scalar|sse2|avx2] [--depth-format float|unorm24|unorm16] [--no-occluders] [--no-lod] [--visibility-buffer] [--msaa 1|4|8] [--width W] [--height H] [--scene cubes|field|overdraw|tiny|textured|lights|<file.obj>] [--texture <image>] [--field-size N] [--output <file.ppm|file.png>] [--depth <file.ppm|file.png>] [--profile] [--trace <file.json>] [--frames-in-flight N]\n";
+    std::cout << "       rasterizer --batch <script> | --turntable N [--workers N] [--threads N] [--writers N] [--output <frame_####.png>] and the scene and renderer options above\n";
+    std::cout << "       --profile records markers and counters, headless runs print a summary and write the trace on exit.\n";
+    std::cout << "       --visibility-buffer rasterizes triangle ids first and shades every visible pixel once afterwards.\n";
+    std::cout << "       --msaa tests coverage and depth at 4 or 8 samples per pixel and shades each pixel once.\n";
+    std::cout << "       --frames-in-flight is the window's latency budget, the finished frames that may wait for display.\n";
+    std::cout << "       --batch renders an image sequence in parallel, every worker with its own framebuffer and scene, --threads is per worker.\n";
+    std::cout << "       Scripts hold \"frames N\", \"camera F x y z angle [ax ay az]\" keys and \"turntable degrees [cx cy cz]\", see animation_script.hpp.\n";
+    std::cout << "       rasterizer --obj-benchmark <file.obj> [--synthetic-mb N] [--threads N]\n";
+}
+
 
+int main(int argc, char **argv)
+{
+    bool headless = false;
+    HeadlessOptions options;
 
-    void draw_shaded_filled_triangle(const std::vector<glm::vec2> &triangle, const std::vector<float> &depth, std::vector<float> brightness, const sf::Color &color)
+    for (int i = 1; i < argc; i++)
     {
-        if (triangle.size() != 3)
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--headless")
+            headless = true;
+        else if (arg == "--frames" && has_value)
+            options.frames = std::stoi(argv[++i]);
+        else if (arg == "--threads" && has_value)
+            options.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--kernel" && has_value)
+            options.kernel = argv[++i];
+        else if (arg == "--depth-format" && has_value)
+            options.depth_format = argv[++i];
+        else if (arg == "--width" && has_value)
+            options.width = std::stoi(argv[++i]);
+        else if (arg == "--height" && has_value)
+            options.height = std::stoi(argv[++i]);
+        else if (arg == "--scene" && has_value)
+            options.scene = argv[++i];
+        else if (arg == "--texture" && has_value)
+            options.texture = argv[++i];
+        else if (arg == "--output" && has_value)
+            options.output = argv[++i];
+        else if (arg == "--depth" && has_value)
+            options.depth_output = argv[++i];
+        else if (arg == "--field-size" && has_value)
+            options.field_size = std::stoi(argv[++i]);
+        else if (arg == "--frames-in-flight" && has_value)
+            options.frames_in_flight = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--profile")
+            options.profile = true;
+        else if (arg == "--trace" && has_value)
         {
-            throw "Wrong size of triangle";
-        }
-        
-        glm::vec2 v0 = triangle[0];
-        glm::vec2 v1 = triangle[1];
-        glm::vec2 v2 = triangle[2];
-
-        float d0 = depth[0];
-        float d1 = depth[1];
-        float d2 = depth[2];
-
-        float h0 = brightness[0];
-        float h1 = brightness[1];
-        float h2 = brightness[2];
-
-        if (v1.y < v0.y)
-        { 
-            std::swap(v1, v0);
-            std::swap(h1, h0);
-            std::swap(d1, d0);
+            options.profile = true;
+            options.trace_path = argv[++i];
         }
-        if (v2.y < v0.y)
+        else if (arg == "--no-occluders")
+            options.occluder_pass = false;
+        else if (arg == "--no-lod")
+            options.lod_selection = false;
+        else if (arg == "--visibility-buffer")
+            options.visibility_buffer = true;
+        else if (arg == "--msaa" && has_value)
+            options.samples = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--batch" && has_value)
+            options.batch_script = argv[++i];
+        else if (arg == "--turntable" && has_value)
+            options.turntable_frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--workers" && has_value)
+            options.workers = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--writers" && has_value)
+            options.writers = static_cast<uint32_t>(std::stoul(argv[++i]));
+        else if (arg == "--obj-benchmark" && has_value)
+            options.obj_benchmark = argv[++i];
+        else if (arg == "--synthetic-mb" && has_value)
+            options.synthetic_megabytes = std::stoul(argv[++i]);
+        else
         {
-            std::swap(v2, v0);
-            std::swap(h2, h0);
-            std::swap(d2, d0);
+            print_usage();
+            return 1;
         }
-        if (v2.y < v1.y)
-        {
-            std::swap(v2, v1);
-            std::swap(h2, h1);
-            std::swap(d2, d1);
-        }
-
-        
-        std::vector<glm::vec2> x01 = interpolate(v0.x, v0.y, v1.x, v1.y);
-        x01.pop_back();
-        std::vector<glm::vec2> x12 = interpolate(v1.x, v1.y, v2.x, v2.y);
-        std::vector<glm::vec2> x02 = interpolate(v0.x, v0.y, v2.x, v2.y);
-                    
-        std::vector<glm::vec2> x012 = x01;
-        x012.insert(x012.end(), x12.begin(), x12.end());
-
-
-        std::vector<glm::vec2> h01 = interpolate(h0, v0.y, h1, v1.y);
-        h01.pop_back();
-        std::vector<glm::vec2> h12 = interpolate(h1, v1.y, h2, v2.y);
-        std::vector<glm::vec2> h02 = interpolate(h0, v0.y, h2, v2.y);
-        
-        std::vector<glm::vec2> h012 = h01;
-        h012.insert(h012.end(), h12.begin(), h12.end());
-
-
-        std::vector<glm::vec2> d01 = interpolate(d0, v0.y, d1, v1.y);
-        d01.pop_back();
-        std::vector<glm::vec2> d12 = interpolate(d1, v1.y, d2, v2.y);
-        std::vector<glm::vec2> d02 = interpolate(d0, v0.y, d2, v2.y);
-        
-        std::vector<glm::vec2> d012 = d01;
-        d012.insert(d012.end(), d12.begin(), d12.end());
-        
-                        
-        for (int32_t i = 0; i < x02.size(); i++)
-        {
-            draw_shaded_line(x02[i], x012[i], d02[i].x, d012[i].x, h02[i].x, h012[i].x, color);
-        }
-
-        draw_shaded_triangle(triangle, depth, brightness, color);
-    }
-
-
-    glm::vec2 viewport_to_canvas(float x, float y)
-    {
-        return glm::vec2(x * WIDTH / static_cast<float>(viewport_width), y * HEIGHT / static_cast<float>(viewport_height));
     }
 
-
-    glm::vec2 project_vertex(const glm::vec4 &vertex)
+    try
     {
-        return viewport_to_canvas(vertex.x * d / vertex.z, vertex.y * d / vertex.z);
-    }
-
-
-    void render_scene()
-    {
-        for (const auto &model : scene.instances)
+        if (!options.obj_benchmark.empty())
         {
-            render_instance(model);
+            benchmark_obj_parser(options.obj_benchmark, options.synthetic_megabytes, options.threads);
         }
-    }
-
-
-    void render_instance(const ModelInstance &instance)
-    {
-        std::vector<glm::vec3> projected;
-        for (const auto &vertex : instance.vertices)
+        else if (!options.batch_script.empty() || options.turntable_frames > 0)
         {
-            glm::vec4 t_vert = camera.view * vertex;
-            glm::vec3 result(project_vertex(t_vert), 1 / t_vert.z);
-
-            projected.push_back(result);
+            Profiler::get().set_enabled(options.profile);
+            BatchApp app(options);
+            app.run();
         }
-        for (const auto &triangle : instance.model.triangles)
+        else if (headless)
         {
-            render_triangle(triangle, projected);
+            Profiler::get().set_enabled(options.profile);
+            HeadlessApp app(options);
+            app.run();
         }
-    }
-
-
-    void render_triangle(const std::pair<std::vector<int32_t>, sf::Color> &triangle, const std::vector<glm::vec3> &projected)
-    {
-        glm::vec3 vert0 = projected[triangle.first[0]];
-        glm::vec3 vert1 = projected[triangle.first[1]];
-        glm::vec3 vert2 = projected[triangle.first[2]];
-        draw_filled_triangle(glm::vec2(vert0), glm::vec2(vert1), glm::vec2(vert2), vert0.z, vert1.z, vert2.z, triangle.second);
-        // draw_triangle(vert0.first, vert1.first, vert2.first, vert0.second, vert1.second, vert2.second, triangle.second);
-    }
-
-
-    void create_scene()
-    {
-        scene.instances = 
+        else
         {
-            {cube, glm::vec3(1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, glm::vec3(2.0f, 0.0f, 7.0f)},
-            {cube, glm::vec3(1.0f), glm::vec3(1.0f), 0.0f, glm::vec3(-1.25f, 0.0f, 7.0f)}
-        };
-    }
-};
-
-
-int main()
-{
-    RaytracerApp app(WINDOW_NAME, WIDTH, HEIGHT);
-    try 
-    {
-        app.run();
+            RaytracerApp app(WINDOW_NAME, WIDTH, HEIGHT, options.trace_path, options.frames_in_flight);
+            app.run();
+        }
     }
     catch (const std::exception& e)
     {
@@ -704,4 +423,4 @@ int main()
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,105 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path)
+{
+    file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        file_handle = nullptr;
+        throw std::runtime_error("Can't open file " + path);
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size))
+    {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Can't read size of file " + path);
+    }
+
+    mapped_size = static_cast<size_t>(file_size.QuadPart);
+    if (mapped_size == 0)
+        return;
+
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_handle == nullptr)
+    {
+        CloseHandle(file_handle);
+        throw std::runtime_error("Can't map file " + path);
+    }
+
+    mapped_data = static_cast<const char *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (mapped_data == nullptr)
+    {
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        throw std::runtime_error("Can't map file " + path);
+    }
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (mapped_data != nullptr)
+        UnmapViewOfFile(mapped_data);
+    if (mapping_handle != nullptr)
+        CloseHandle(mapping_handle);
+    if (file_handle != nullptr)
+        CloseHandle(file_handle);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path)
+{
+    file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0)
+        throw std::runtime_error("Can't open file " + path);
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0)
+    {
+        close(file_descriptor);
+        throw std::runtime_error("Can't read size of file " + path);
+    }
+
+    mapped_size = static_cast<size_t>(file_stat.st_size);
+    if (mapped_size == 0)
+        return;
+
+    void *address = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (address == MAP_FAILED)
+    {
+        close(file_descriptor);
+        throw std::runtime_error("Can't map file " + path);
+    }
+
+    madvise(address, mapped_size, MADV_SEQUENTIAL);
+    mapped_data = static_cast<const char *>(address);
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (mapped_data != nullptr)
+        munmap(const_cast<char *>(mapped_data), mapped_size);
+    if (file_descriptor >= 0)
+        close(file_descriptor);
+}
+
+#endif
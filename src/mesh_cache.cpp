@@ -0,0 +1,332 @@
+#include "mesh_cache.hpp"
+#include "mapped_file.hpp"
+#include "mesh_simplify.hpp"
+#include "meshlets.hpp"
+#include "thread_pool.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+
+// Also bump it when build_meshlets, simplify_mesh or LOD_MIN_TRIANGLES change, the cache holds their output.
+static constexpr uint32_t MESH_CACHE_VERSION = 5;
+static constexpr char MESH_CACHE_MAGIC[8] = { 'R', 'M', 'E', 'S', 'H', 0, 0, 0 };
+static constexpr size_t MESH_CACHE_ALIGNMENT = 64;
+static constexpr size_t HASH_BLOCK_SIZE = 4 * 1024 * 1024;
+
+static constexpr uint64_t HASH_PRIME0 = 0x9e3779b97f4a7c15ull;
+static constexpr uint64_t HASH_PRIME1 = 0xc2b2ae3d27d4eb4full;
+
+
+enum MeshCacheSection
+{
+    POSITIONS,
+    NORMALS,
+    UVS,
+    INDICES,
+    MATERIAL_IDS,
+    MATERIALS,
+    MESHLETS,
+    MESHLET_VERTICES,
+    MESHLET_TRIANGLES,
+    SECTION_COUNT
+};
+
+
+struct MeshCacheSectionInfo
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+
+// Streams of one level of detail, level 0 is the mesh itself.
+struct MeshCacheLevel
+{
+    MeshCacheSectionInfo sections[SECTION_COUNT];
+};
+
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t source_hash;
+    uint64_t source_size;
+    // Array of MeshCacheLevel, written after the streams of all levels.
+    MeshCacheSectionInfo levels;
+};
+
+
+static uint64_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdull;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ull;
+    value ^= value >> 33;
+    return value;
+}
+
+
+static uint64_t hash_block(const char *data, size_t size)
+{
+    uint64_t hash = size * HASH_PRIME0;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash ^= word * HASH_PRIME1;
+        hash = ((hash << 31) | (hash >> 33)) * HASH_PRIME0;
+    }
+
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    hash ^= tail * HASH_PRIME1;
+
+    return mix(hash);
+}
+
+
+uint64_t hash_source(std::string_view data, uint32_t thread_count)
+{
+    size_t block_count = (data.size() + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE;
+    std::vector<uint64_t> block_hashes(block_count);
+
+    ThreadPool pool(block_count > 1 ? thread_count : 1);
+    pool.parallel_for(static_cast<uint32_t>(block_count), [&](uint32_t index, uint32_t)
+    {
+        size_t begin = static_cast<size_t>(index) * HASH_BLOCK_SIZE;
+        block_hashes[index] = hash_block(data.data() + begin, std::min(HASH_BLOCK_SIZE, data.size() - begin));
+    });
+
+    uint64_t hash = mix(data.size() ^ HASH_PRIME1);
+    for (uint64_t block_hash : block_hashes)
+    {
+        hash = mix(hash ^ (block_hash * HASH_PRIME0));
+    }
+    return hash;
+}
+
+
+static size_t align_offset(size_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+
+template <typename T>
+static bool read_section(const MappedFile &file, const MeshCacheSectionInfo &section, std::vector<T> &target)
+{
+    if (section.offset % MESH_CACHE_ALIGNMENT != 0 || section.offset > file.size() || section.count > (file.size() - section.offset) / sizeof(T))
+        return false;
+
+    target.resize(section.count);
+    std::memcpy(target.data(), file.data() + section.offset, section.count * sizeof(T));
+    return true;
+}
+
+
+// Renderers index with the cached values unchecked, so a cache that passed the hash but was damaged or written by a
+// broken build must not get that far.
+static bool is_valid_mesh(const Mesh &mesh)
+{
+    size_t vertex_count = mesh.positions.size();
+    size_t triangle_count = mesh.get_triangle_count();
+    if ((!mesh.normals.empty() && mesh.normals.size() != vertex_count) || (!mesh.uvs.empty() && mesh.uvs.size() != vertex_count))
+        return false;
+    if (mesh.indices.size() % 3 != 0 || mesh.material_ids.size() != triangle_count)
+        return false;
+
+    for (uint32_t index : mesh.indices)
+    {
+        if (index >= vertex_count)
+            return false;
+    }
+    for (uint16_t material_id : mesh.material_ids)
+    {
+        if (material_id >= mesh.materials.size())
+            return false;
+    }
+
+    if (mesh.meshlets.empty())
+        return mesh.meshlet_vertices.empty() && mesh.meshlet_triangles.empty();
+    if (mesh.meshlet_triangles.size() != mesh.indices.size())
+        return false;
+    for (uint32_t index : mesh.meshlet_vertices)
+    {
+        if (index >= vertex_count)
+            return false;
+    }
+    for (const Meshlet &meshlet : mesh.meshlets)
+    {
+        if (static_cast<uint64_t>(meshlet.triangle_offset) + meshlet.triangle_count > triangle_count)
+            return false;
+        if (static_cast<uint64_t>(meshlet.vertex_offset) + meshlet.vertex_count > mesh.meshlet_vertices.size())
+            return false;
+        size_t end = (static_cast<size_t>(meshlet.triangle_offset) + meshlet.triangle_count) * 3;
+        for (size_t i = static_cast<size_t>(meshlet.triangle_offset) * 3; i < end; i++)
+        {
+            if (mesh.meshlet_triangles[i] >= meshlet.vertex_count)
+                return false;
+        }
+    }
+    return true;
+}
+
+
+static bool read_level(const MappedFile &file, const MeshCacheLevel &level, Mesh &mesh)
+{
+    return read_section(file, level.sections[POSITIONS], mesh.positions)
+        && read_section(file, level.sections[NORMALS], mesh.normals)
+        && read_section(file, level.sections[UVS], mesh.uvs)
+        && read_section(file, level.sections[INDICES], mesh.indices)
+        && read_section(file, level.sections[MATERIAL_IDS], mesh.material_ids)
+        && read_section(file, level.sections[MATERIALS], mesh.materials)
+        && read_section(file, level.sections[MESHLETS], mesh.meshlets)
+        && read_section(file, level.sections[MESHLET_VERTICES], mesh.meshlet_vertices)
+        && read_section(file, level.sections[MESHLET_TRIANGLES], mesh.meshlet_triangles)
+        && is_valid_mesh(mesh);
+}
+
+
+bool read_mesh_cache(const std::string &cache_path, uint64_t source_hash, uint64_t source_size, Mesh &mesh, std::vector<Mesh> &lods)
+{
+    if (!std::filesystem::exists(cache_path))
+        return false;
+
+    MappedFile file(cache_path);
+    if (file.size() < sizeof(MeshCacheHeader))
+        return false;
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 || header.version != MESH_CACHE_VERSION || header.header_size != sizeof(MeshCacheHeader))
+        return false;
+    if (header.source_hash != source_hash || header.source_size != source_size)
+        return false;
+
+    std::vector<MeshCacheLevel> levels;
+    if (!read_section(file, header.levels, levels) || levels.empty() || !read_level(file, levels[0], mesh))
+        return false;
+
+    lods.resize(levels.size() - 1);
+    for (size_t i = 0; i < lods.size(); i++)
+    {
+        if (!read_level(file, levels[i + 1], lods[i]))
+            return false;
+    }
+    return true;
+}
+
+
+template <typename T>
+static void write_section(std::ofstream &out_file, const std::vector<T> &source, MeshCacheSectionInfo &section)
+{
+    static const char padding[MESH_CACHE_ALIGNMENT] = {};
+
+    size_t position = static_cast<size_t>(out_file.tellp());
+    size_t offset = align_offset(position);
+    out_file.write(padding, offset - position);
+
+    section.offset = offset;
+    section.count = source.size();
+    out_file.write(reinterpret_cast<const char *>(source.data()), source.size() * sizeof(T));
+}
+
+
+static MeshCacheLevel write_level(std::ofstream &out_file, const Mesh &mesh)
+{
+    MeshCacheLevel level {};
+    write_section(out_file, mesh.positions, level.sections[POSITIONS]);
+    write_section(out_file, mesh.normals, level.sections[NORMALS]);
+    write_section(out_file, mesh.uvs, level.sections[UVS]);
+    write_section(out_file, mesh.indices, level.sections[INDICES]);
+    write_section(out_file, mesh.material_ids, level.sections[MATERIAL_IDS]);
+    write_section(out_file, mesh.materials, level.sections[MATERIALS]);
+    write_section(out_file, mesh.meshlets, level.sections[MESHLETS]);
+    write_section(out_file, mesh.meshlet_vertices, level.sections[MESHLET_VERTICES]);
+    write_section(out_file, mesh.meshlet_triangles, level.sections[MESHLET_TRIANGLES]);
+    return level;
+}
+
+
+void write_mesh_cache(const std::string &cache_path, uint64_t source_hash, uint64_t source_size, const Mesh &mesh, const std::vector<Mesh> &lods)
+{
+    std::string temporary_path = cache_path + ".tmp";
+
+    {
+        std::ofstream out_file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!out_file.is_open())
+            throw std::runtime_error("Can't write mesh cache " + temporary_path);
+
+        MeshCacheHeader header {};
+        std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+        header.version = MESH_CACHE_VERSION;
+        header.header_size = sizeof(MeshCacheHeader);
+        header.source_hash = source_hash;
+        header.source_size = source_size;
+
+        out_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        std::vector<MeshCacheLevel> levels;
+        levels.push_back(write_level(out_file, mesh));
+        for (const Mesh &lod : lods)
+        {
+            levels.push_back(write_level(out_file, lod));
+        }
+        write_section(out_file, levels, header.levels);
+
+        out_file.seekp(0);
+        out_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if (!out_file.good())
+            throw std::runtime_error("Can't write mesh cache " + temporary_path);
+    }
+
+    std::filesystem::rename(temporary_path, cache_path);
+}
+
+
+Mesh load_obj_cached(const std::string &path, std::vector<Mesh> &lods, uint32_t thread_count)
+{
+    std::string cache_path = path + ".rmesh";
+
+    MappedFile source(path);
+    uint64_t source_hash = hash_source(source.view(), thread_count);
+
+    // A missing or unreadable cache only costs startup time, so neither is an error.
+    Mesh mesh;
+    try
+    {
+        if (read_mesh_cache(cache_path, source_hash, source.size(), mesh, lods))
+            return mesh;
+    }
+    catch (const std::exception &)
+    {
+    }
+
+    mesh = build_mesh(parse_obj_text(source.view(), thread_count));
+    build_meshlets(mesh);
+    lods = build_lod_chain(mesh, LOD_MIN_TRIANGLES);
+    for (Mesh &lod : lods)
+    {
+        build_meshlets(lod);
+    }
+
+    try
+    {
+        write_mesh_cache(cache_path, source_hash, source.size(), mesh, lods);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "mesh cache not written: " << e.what() << "\n";
+    }
+
+    return mesh;
+}
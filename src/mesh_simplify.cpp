@@ -0,0 +1,353 @@
+#include "mesh_simplify.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+
+
+// Sum of squared distances to a set of weighted planes, the upper triangle of a symmetric 4x4 matrix.
+struct Quadric
+{
+    double a[10] = {};
+
+    void add_plane(const glm::dvec3 &normal, double distance, double weight)
+    {
+        double plane[4] = { normal.x, normal.y, normal.z, distance };
+        int32_t k = 0;
+        for (int32_t i = 0; i < 4; i++)
+        {
+            for (int32_t j = i; j < 4; j++)
+            {
+                a[k++] += weight * plane[i] * plane[j];
+            }
+        }
+    }
+
+    void add(const Quadric &other)
+    {
+        for (int32_t i = 0; i < 10; i++)
+        {
+            a[i] += other.a[i];
+        }
+    }
+
+    double evaluate(const glm::vec3 &point) const
+    {
+        double x = point.x;
+        double y = point.y;
+        double z = point.z;
+        return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+            + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+            + a[7] * z * z + 2.0 * a[8] * z
+            + a[9];
+    }
+};
+
+
+// Moving vertex from onto to, valid while neither changed since the cost was computed.
+struct Collapse
+{
+    double cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t from_version;
+    uint32_t to_version;
+
+    bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+
+// Rejects collapses that turn a triangle by more than about 80 degrees, which catches flips and slivers.
+static constexpr double MIN_NORMAL_COSINE = 0.2;
+
+
+// Vertices that share a position get the same id, so seams are seen as one surface.
+static std::vector<uint32_t> weld_positions(const std::vector<glm::vec3> &positions, uint32_t &count)
+{
+    std::vector<uint32_t> order(positions.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto less = [&](uint32_t a, uint32_t b)
+    {
+        const glm::vec3 &p = positions[a];
+        const glm::vec3 &q = positions[b];
+        return p.x != q.x ? p.x < q.x : (p.y != q.y ? p.y < q.y : p.z < q.z);
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    std::vector<uint32_t> ids(positions.size());
+    count = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (i > 0 && less(order[i - 1], order[i]))
+            count++;
+        ids[order[i]] = count;
+    }
+    count = positions.empty() ? 0 : count + 1;
+    return ids;
+}
+
+
+Mesh simplify_mesh(const Mesh &mesh, size_t target_triangles)
+{
+    size_t vertex_count = mesh.positions.size();
+    size_t triangle_count = mesh.get_triangle_count();
+    if (triangle_count <= target_triangles)
+        return mesh;
+
+    uint32_t position_count = 0;
+    std::vector<uint32_t> position_ids = weld_positions(mesh.positions, position_count);
+
+    // Vertices sharing a position with another one lie on an attribute seam.
+    std::vector<uint32_t> vertices_per_position(position_count, 0);
+    for (uint32_t id : position_ids)
+    {
+        vertices_per_position[id]++;
+    }
+
+    // Edges used by other than two triangles are open borders or non-manifold, their ends are locked.
+    std::vector<uint64_t> edges;
+    edges.reserve(triangle_count * 3);
+    for (size_t i = 0; i < triangle_count; i++)
+    {
+        for (int32_t corner = 0; corner < 3; corner++)
+        {
+            uint64_t a = position_ids[mesh.indices[i * 3 + corner]];
+            uint64_t b = position_ids[mesh.indices[i * 3 + (corner + 1) % 3]];
+            if (a != b)
+                edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<bool> locked_positions(position_count, false);
+    for (size_t i = 0; i < edges.size();)
+    {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+        {
+            j++;
+        }
+        if (j - i != 2)
+        {
+            locked_positions[edges[i] >> 32] = true;
+            locked_positions[edges[i] & 0xffffffffu] = true;
+        }
+        i = j;
+    }
+
+    std::vector<bool> locked(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        locked[v] = vertices_per_position[position_ids[v]] > 1 || locked_positions[position_ids[v]];
+    }
+
+    // Area weighted planes of the triangles around each position.
+    std::vector<Quadric> quadrics(position_count);
+    std::vector<std::vector<uint32_t>> vertex_triangles(vertex_count);
+    for (uint32_t i = 0; i < triangle_count; i++)
+    {
+        glm::dvec3 p0 = mesh.positions[mesh.indices[i * 3]];
+        glm::dvec3 p1 = mesh.positions[mesh.indices[i * 3 + 1]];
+        glm::dvec3 p2 = mesh.positions[mesh.indices[i * 3 + 2]];
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        double length = glm::length(normal);
+
+        for (int32_t corner = 0; corner < 3; corner++)
+        {
+            uint32_t vertex = mesh.indices[i * 3 + corner];
+            vertex_triangles[vertex].push_back(i);
+            if (length > 0.0)
+                quadrics[position_ids[vertex]].add_plane(normal / length, -glm::dot(normal / length, p0), length * 0.5);
+        }
+    }
+
+    std::vector<uint32_t> indices = mesh.indices;
+    std::vector<bool> alive(triangle_count, true);
+    std::vector<bool> removed(vertex_count, false);
+    std::vector<uint32_t> versions(vertex_count, 0);
+    size_t alive_count = triangle_count;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    auto push = [&](uint32_t from, uint32_t to)
+    {
+        if (locked[from] || from == to)
+            return;
+        Quadric quadric = quadrics[position_ids[from]];
+        quadric.add(quadrics[position_ids[to]]);
+        queue.push(Collapse { quadric.evaluate(mesh.positions[to]), from, to, versions[from], versions[to] });
+    };
+
+    for (size_t i = 0; i < triangle_count; i++)
+    {
+        for (int32_t corner = 0; corner < 3; corner++)
+        {
+            push(indices[i * 3 + corner], indices[i * 3 + (corner + 1) % 3]);
+            push(indices[i * 3 + (corner + 1) % 3], indices[i * 3 + corner]);
+        }
+    }
+
+    std::vector<uint32_t> from_neighbors;
+    std::vector<uint32_t> to_neighbors;
+    while (alive_count > target_triangles && !queue.empty())
+    {
+        Collapse collapse = queue.top();
+        queue.pop();
+
+        uint32_t from = collapse.from;
+        uint32_t to = collapse.to;
+        if (removed[from] || removed[to] || versions[from] != collapse.from_version || versions[to] != collapse.to_version)
+            continue;
+
+        // Triangles that keep their area must keep their orientation.
+        size_t shared = 0;
+        bool flips = false;
+        from_neighbors.clear();
+        for (uint32_t triangle : vertex_triangles[from])
+        {
+            if (!alive[triangle])
+                continue;
+
+            const uint32_t *corners = &indices[triangle * 3];
+            for (int32_t corner = 0; corner < 3; corner++)
+            {
+                if (corners[corner] != from)
+                    from_neighbors.push_back(position_ids[corners[corner]]);
+            }
+
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+            {
+                shared++;
+                continue;
+            }
+
+            glm::dvec3 points[3];
+            glm::dvec3 moved[3];
+            for (int32_t corner = 0; corner < 3; corner++)
+            {
+                points[corner] = mesh.positions[corners[corner]];
+                moved[corner] = mesh.positions[corners[corner] == from ? to : corners[corner]];
+            }
+            glm::dvec3 before = glm::cross(points[1] - points[0], points[2] - points[0]);
+            glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= MIN_NORMAL_COSINE * glm::length(before) * glm::length(after))
+            {
+                flips = true;
+                break;
+            }
+        }
+        if (flips || shared == 0)
+            continue;
+
+        // Link condition: the two ends may only share the neighbors opposite the edge, or the surface would pinch.
+        to_neighbors.clear();
+        for (uint32_t triangle : vertex_triangles[to])
+        {
+            if (!alive[triangle])
+                continue;
+            for (int32_t corner = 0; corner < 3; corner++)
+            {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                if (vertex != to)
+                    to_neighbors.push_back(position_ids[vertex]);
+            }
+        }
+        std::sort(from_neighbors.begin(), from_neighbors.end());
+        from_neighbors.erase(std::unique(from_neighbors.begin(), from_neighbors.end()), from_neighbors.end());
+        std::sort(to_neighbors.begin(), to_neighbors.end());
+        to_neighbors.erase(std::unique(to_neighbors.begin(), to_neighbors.end()), to_neighbors.end());
+
+        size_t common = 0;
+        for (uint32_t neighbor : from_neighbors)
+        {
+            if (neighbor != position_ids[to] && std::binary_search(to_neighbors.begin(), to_neighbors.end(), neighbor))
+                common++;
+        }
+        if (common != shared)
+            continue;
+
+        removed[from] = true;
+        versions[to]++;
+        quadrics[position_ids[to]].add(quadrics[position_ids[from]]);
+
+        for (uint32_t triangle : vertex_triangles[from])
+        {
+            if (!alive[triangle])
+                continue;
+
+            uint32_t *corners = &indices[triangle * 3];
+            if (corners[0] == to || corners[1] == to || corners[2] == to)
+            {
+                alive[triangle] = false;
+                alive_count--;
+                continue;
+            }
+            for (int32_t corner = 0; corner < 3; corner++)
+            {
+                if (corners[corner] == from)
+                    corners[corner] = to;
+            }
+            vertex_triangles[to].push_back(triangle);
+        }
+        vertex_triangles[from].clear();
+
+        // Collapses around to were priced with its old quadric.
+        auto &around = vertex_triangles[to];
+        around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t triangle) { return !alive[triangle]; }), around.end());
+        for (uint32_t triangle : around)
+        {
+            for (int32_t corner = 0; corner < 3; corner++)
+            {
+                uint32_t vertex = indices[triangle * 3 + corner];
+                push(vertex, to);
+                push(to, vertex);
+            }
+        }
+    }
+
+    // Compacts the surviving triangles and the vertices they use, in their original order.
+    Mesh result;
+    result.materials = mesh.materials;
+    std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+    for (size_t i = 0; i < triangle_count; i++)
+    {
+        if (!alive[i])
+            continue;
+
+        for (int32_t corner = 0; corner < 3; corner++)
+        {
+            uint32_t vertex = indices[i * 3 + corner];
+            if (remap[vertex] == UINT32_MAX)
+            {
+                remap[vertex] = static_cast<uint32_t>(result.positions.size());
+                result.positions.push_back(mesh.positions[vertex]);
+                if (!mesh.normals.empty())
+                    result.normals.push_back(mesh.normals[vertex]);
+                if (!mesh.uvs.empty())
+                    result.uvs.push_back(mesh.uvs[vertex]);
+            }
+            result.indices.push_back(remap[vertex]);
+        }
+        result.material_ids.push_back(mesh.material_ids[i]);
+    }
+    return result;
+}
+
+
+std::vector<Mesh> build_lod_chain(const Mesh &mesh, size_t min_triangles)
+{
+    std::vector<Mesh> lods;
+    while (true)
+    {
+        const Mesh &previous = lods.empty() ? mesh : lods.back();
+        size_t target = previous.get_triangle_count() / 2;
+        if (target < min_triangles)
+            break;
+
+        Mesh lod = simplify_mesh(previous, target);
+        // Locked vertices can hold a mesh well above the target, the next levels would hardly differ.
+        if (lod.get_triangle_count() * 10 > previous.get_triangle_count() * 9)
+            break;
+        lods.push_back(std::move(lod));
+    }
+    return lods;
+}
@@ -0,0 +1,209 @@
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+// Weight of a candidate's angle to the meshlet's average normal against the new vertices it brings. Without it meshlets
+// of curved surfaces span so many directions that their cones never cull.
+static constexpr float CONE_WEIGHT = 2.0f;
+
+// Cones wider than about 84 degrees are too wide to ever reject a meshlet from a reasonable distance.
+static constexpr float MIN_CONE_SPREAD = 0.1f;
+
+
+static void compute_meshlet_bounds(const Mesh &mesh, const std::vector<uint32_t> &indices, Meshlet &meshlet)
+{
+    std::vector<glm::vec3> points(meshlet.vertex_count);
+    for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+    {
+        points[i] = mesh.positions[mesh.meshlet_vertices[meshlet.vertex_offset + i]];
+    }
+    meshlet.sphere = compute_bounding_sphere(points, compute_bounds(points));
+
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis(0.0f);
+    for (uint32_t i = meshlet.triangle_offset; i < meshlet.triangle_offset + meshlet.triangle_count; i++)
+    {
+        const glm::vec3 &p0 = mesh.positions[indices[i * 3]];
+        const glm::vec3 &p1 = mesh.positions[indices[i * 3 + 1]];
+        const glm::vec3 &p2 = mesh.positions[indices[i * 3 + 2]];
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+
+        // Degenerate triangles are never drawn and have no direction.
+        if (length > 0.0f)
+        {
+            normals.push_back(normal / length);
+            axis += normals.back();
+        }
+    }
+
+    meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.cone_cutoff = 1.0f;
+    float axis_length = glm::length(axis);
+    if (normals.empty() || axis_length <= 0.0f)
+        return;
+
+    axis /= axis_length;
+    float min_dot = 1.0f;
+    for (const glm::vec3 &normal : normals)
+    {
+        min_dot = std::min(min_dot, glm::dot(normal, axis));
+    }
+
+    meshlet.cone_axis = axis;
+    if (min_dot > MIN_CONE_SPREAD)
+        meshlet.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+}
+
+
+void build_meshlets(Mesh &mesh)
+{
+    size_t triangle_count = mesh.get_triangle_count();
+    size_t vertex_count = mesh.positions.size();
+
+    // Triangles around each vertex, packed per vertex.
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+    for (uint32_t index : mesh.indices)
+    {
+        adjacency_offsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        adjacency_offsets[v + 1] += adjacency_offsets[v];
+    }
+    std::vector<uint32_t> adjacency(mesh.indices.size());
+    std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (size_t i = 0; i < mesh.indices.size(); i++)
+    {
+        adjacency[fill[mesh.indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<uint32_t> indices;
+    std::vector<uint16_t> material_ids;
+    indices.reserve(mesh.indices.size());
+    material_ids.reserve(triangle_count);
+
+    mesh.meshlets.clear();
+    mesh.meshlet_vertices.clear();
+    mesh.meshlet_triangles.clear();
+    mesh.meshlet_triangles.reserve(mesh.indices.size());
+
+    std::vector<glm::vec3> triangle_normals(triangle_count, glm::vec3(0.0f));
+    for (size_t i = 0; i < triangle_count; i++)
+    {
+        const glm::vec3 &p0 = mesh.positions[mesh.indices[i * 3]];
+        const glm::vec3 &p1 = mesh.positions[mesh.indices[i * 3 + 1]];
+        const glm::vec3 &p2 = mesh.positions[mesh.indices[i * 3 + 2]];
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(normal);
+        if (length > 0.0f)
+            triangle_normals[i] = normal / length;
+    }
+
+    std::vector<bool> emitted(triangle_count, false);
+    // Index of a vertex inside the meshlet being built.
+    std::vector<uint32_t> local_index(vertex_count, UINT32_MAX);
+    std::vector<uint32_t> candidates;
+    size_t next_seed = 0;
+
+    auto count_new_vertices = [&](uint32_t triangle)
+    {
+        uint32_t count = 0;
+        for (int32_t corner = 0; corner < 3; corner++)
+        {
+            count += local_index[mesh.indices[triangle * 3 + corner]] == UINT32_MAX;
+        }
+        return count;
+    };
+
+    while (material_ids.size() < triangle_count)
+    {
+        Meshlet meshlet {};
+        meshlet.triangle_offset = static_cast<uint32_t>(material_ids.size());
+        meshlet.vertex_offset = static_cast<uint32_t>(mesh.meshlet_vertices.size());
+        candidates.clear();
+        glm::vec3 normal_sum(0.0f);
+
+        while (meshlet.triangle_count < MESHLET_MAX_TRIANGLES)
+        {
+            // Fewest new vertices and least bend win, ties go to the earliest found, which grows the meshlet in rings around its seed.
+            size_t best = SIZE_MAX;
+            uint32_t best_new_vertices = 4;
+            float best_score = 1e30f;
+            float sum_length = glm::length(normal_sum);
+            glm::vec3 axis = sum_length > 0.0f ? normal_sum / sum_length : glm::vec3(0.0f);
+            size_t kept = 0;
+            for (size_t i = 0; i < candidates.size(); i++)
+            {
+                uint32_t triangle = candidates[i];
+                if (emitted[triangle])
+                    continue;
+
+                uint32_t new_vertices = count_new_vertices(triangle);
+                float score = static_cast<float>(new_vertices) + CONE_WEIGHT * (1.0f - glm::dot(axis, triangle_normals[triangle]));
+                if (score < best_score)
+                {
+                    best = kept;
+                    best_score = score;
+                    best_new_vertices = new_vertices;
+                }
+                candidates[kept++] = triangle;
+            }
+            candidates.resize(kept);
+
+            uint32_t triangle;
+            if (best != SIZE_MAX)
+            {
+                triangle = candidates[best];
+            }
+            else
+            {
+                // Nothing connected is left, continue with the next triangle in mesh order.
+                while (next_seed < triangle_count && emitted[next_seed])
+                {
+                    next_seed++;
+                }
+                if (next_seed == triangle_count)
+                    break;
+                triangle = static_cast<uint32_t>(next_seed);
+                best_new_vertices = count_new_vertices(triangle);
+            }
+
+            if (meshlet.vertex_count + best_new_vertices > MESHLET_MAX_VERTICES)
+                break;
+
+            emitted[triangle] = true;
+            normal_sum += triangle_normals[triangle];
+            for (int32_t corner = 0; corner < 3; corner++)
+            {
+                uint32_t vertex = mesh.indices[triangle * 3 + corner];
+                if (local_index[vertex] == UINT32_MAX)
+                {
+                    local_index[vertex] = meshlet.vertex_count++;
+                    mesh.meshlet_vertices.push_back(vertex);
+                    for (uint32_t i = adjacency_offsets[vertex]; i < adjacency_offsets[vertex + 1]; i++)
+                    {
+                        if (!emitted[adjacency[i]])
+                            candidates.push_back(adjacency[i]);
+                    }
+                }
+                indices.push_back(vertex);
+                mesh.meshlet_triangles.push_back(static_cast<uint8_t>(local_index[vertex]));
+            }
+            material_ids.push_back(mesh.material_ids[triangle]);
+            meshlet.triangle_count++;
+        }
+
+        for (uint32_t i = 0; i < meshlet.vertex_count; i++)
+        {
+            local_index[mesh.meshlet_vertices[meshlet.vertex_offset + i]] = UINT32_MAX;
+        }
+        compute_meshlet_bounds(mesh, indices, meshlet);
+        mesh.meshlets.push_back(meshlet);
+    }
+
+    mesh.indices = std::move(indices);
+    mesh.material_ids = std::move(material_ids);
+}
@@ -0,0 +1,424 @@
+#include "obj_parser.hpp"
+#include "mapped_file.hpp"
+#include "thread_pool.hpp"
+
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+
+// Chunks smaller than this aren't worth a thread.
+static constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+
+struct ObjChunk
+{
+    std::string_view text;
+
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uvs;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjIndex> indices;
+
+    // Corners (index * 3 + component) written from a negative index, relative to the start of this chunk.
+    std::vector<uint32_t> relative_corners;
+
+    std::vector<ObjIndex> face;
+    std::vector<uint8_t> face_relative;
+};
+
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static const char *skip_spaces(const char *cursor, const char *end)
+{
+    while (cursor < end && is_space(*cursor))
+        cursor++;
+    return cursor;
+}
+
+
+[[noreturn]] static void throw_malformed(const char *cursor, const char *end)
+{
+    const char *line_end = std::find(cursor, end, '\n');
+    if (line_end == cursor)
+        throw std::runtime_error("Malformed obj line: unexpected end of line");
+    throw std::runtime_error("Malformed obj line near \"" + std::string(cursor, std::min<size_t>(line_end - cursor, 64)) + "\"");
+}
+
+
+static const char *parse_float(const char *cursor, const char *end, float &value)
+{
+    cursor = skip_spaces(cursor, end);
+    if (cursor < end && *cursor == '+')
+        cursor++;
+
+    auto [next, error] = std::from_chars(cursor, end, value);
+    if (error != std::errc())
+        throw_malformed(cursor, end);
+    return next;
+}
+
+
+static const char *parse_int(const char *cursor, const char *end, int32_t &value)
+{
+    auto [next, error] = std::from_chars(cursor, end, value);
+    if (error != std::errc())
+        throw_malformed(cursor, end);
+    return next;
+}
+
+
+// Turns a one-based or negative OBJ index into a zero-based one. Negative indices count back from the
+// elements seen so far in this chunk and are fixed up with the chunk's global offset when merging.
+static int32_t resolve_index(int32_t value, size_t local_count, bool &relative)
+{
+    if (value > 0)
+    {
+        relative = false;
+        return value - 1;
+    }
+    if (value < 0)
+    {
+        relative = true;
+        return static_cast<int32_t>(local_count) + value;
+    }
+    throw std::runtime_error("Obj index 0 is invalid");
+}
+
+
+static const char *parse_face(const char *cursor, const char *end, ObjChunk &chunk)
+{
+    chunk.face.clear();
+    chunk.face_relative.clear();
+
+    while (true)
+    {
+        cursor = skip_spaces(cursor, end);
+        if (cursor == end || *cursor == '\n' || *cursor == '#')
+            break;
+
+        ObjIndex corner { -1, -1, -1 };
+        uint8_t relative_components = 0;
+        bool relative = false;
+        int32_t value = 0;
+
+        cursor = parse_int(cursor, end, value);
+        corner.position = resolve_index(value, chunk.positions.size(), relative);
+        relative_components |= relative ? 1 : 0;
+
+        if (cursor < end && *cursor == '/')
+        {
+            cursor++;
+            if (cursor < end && *cursor != '/')
+            {
+                cursor = parse_int(cursor, end, value);
+                corner.uv = resolve_index(value, chunk.uvs.size(), relative);
+                relative_components |= relative ? 2 : 0;
+            }
+            if (cursor < end && *cursor == '/')
+            {
+                cursor = parse_int(cursor + 1, end, value);
+                corner.normal = resolve_index(value, chunk.normals.size(), relative);
+                relative_components |= relative ? 4 : 0;
+            }
+        }
+
+        chunk.face.push_back(corner);
+        chunk.face_relative.push_back(relative_components);
+    }
+
+    if (chunk.face.size() < 3)
+        throw_malformed(cursor, end);
+
+    for (size_t i = 1; i + 1 < chunk.face.size(); i++)
+    {
+        for (size_t corner : {size_t(0), i, i + 1})
+        {
+            uint32_t index = static_cast<uint32_t>(chunk.indices.size());
+            chunk.indices.push_back(chunk.face[corner]);
+
+            for (uint32_t component = 0; component < 3; component++)
+            {
+                if (chunk.face_relative[corner] & (1u << component))
+                    chunk.relative_corners.push_back(index * 3 + component);
+            }
+        }
+    }
+
+    return cursor;
+}
+
+
+static void parse_chunk(ObjChunk &chunk)
+{
+    const char *cursor = chunk.text.data();
+    const char *end = cursor + chunk.text.size();
+
+    while (cursor < end)
+    {
+        cursor = skip_spaces(cursor, end);
+
+        if (cursor + 1 < end && cursor[0] == 'v' && is_space(cursor[1]))
+        {
+            glm::vec3 position;
+            cursor = parse_float(cursor + 2, end, position.x);
+            cursor = parse_float(cursor, end, position.y);
+            cursor = parse_float(cursor, end, position.z);
+            chunk.positions.push_back(position);
+        }
+        else if (cursor + 2 < end && cursor[0] == 'v' && cursor[1] == 't' && is_space(cursor[2]))
+        {
+            glm::vec2 uv;
+            cursor = parse_float(cursor + 3, end, uv.x);
+            cursor = parse_float(cursor, end, uv.y);
+            chunk.uvs.push_back(uv);
+        }
+        else if (cursor + 2 < end && cursor[0] == 'v' && cursor[1] == 'n' && is_space(cursor[2]))
+        {
+            glm::vec3 normal;
+            cursor = parse_float(cursor + 3, end, normal.x);
+            cursor = parse_float(cursor, end, normal.y);
+            cursor = parse_float(cursor, end, normal.z);
+            chunk.normals.push_back(normal);
+        }
+        else if (cursor + 1 < end && cursor[0] == 'f' && is_space(cursor[1]))
+        {
+            cursor = parse_face(cursor + 2, end, chunk);
+        }
+
+        // Whatever is left on the line (comments, w components, unsupported statements) is skipped.
+        cursor = std::find(cursor, end, '\n');
+        if (cursor < end)
+            cursor++;
+    }
+}
+
+
+static void check_range(int32_t index, size_t count, bool optional)
+{
+    if (index < (optional ? -1 : 0) || index >= static_cast<int64_t>(count))
+        throw std::runtime_error("Obj face index out of range");
+}
+
+
+ObjData parse_obj_text(std::string_view text, uint32_t thread_count)
+{
+    ThreadPool pool(thread_count);
+
+    size_t chunk_count = std::max<size_t>(1, std::min<size_t>(pool.get_thread_count() * 4, text.size() / MIN_CHUNK_SIZE));
+    std::vector<ObjChunk> chunks(chunk_count);
+
+    size_t begin = 0;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        size_t end = i + 1 == chunk_count ? text.size() : std::max(begin, text.size() * (i + 1) / chunk_count);
+        end = text.find('\n', end);
+        end = end == std::string_view::npos ? text.size() : end + 1;
+
+        chunks[i].text = text.substr(begin, end - begin);
+        begin = end;
+    }
+
+    pool.parallel_for(static_cast<uint32_t>(chunk_count), [&](uint32_t index, uint32_t)
+    {
+        parse_chunk(chunks[index]);
+    });
+
+    std::vector<size_t> position_offsets(chunk_count + 1, 0);
+    std::vector<size_t> uv_offsets(chunk_count + 1, 0);
+    std::vector<size_t> normal_offsets(chunk_count + 1, 0);
+    std::vector<size_t> index_offsets(chunk_count + 1, 0);
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        position_offsets[i + 1] = position_offsets[i] + chunks[i].positions.size();
+        uv_offsets[i + 1] = uv_offsets[i] + chunks[i].uvs.size();
+        normal_offsets[i + 1] = normal_offsets[i] + chunks[i].normals.size();
+        index_offsets[i + 1] = index_offsets[i] + chunks[i].indices.size();
+    }
+
+    ObjData result;
+    result.positions.resize(position_offsets[chunk_count]);
+    result.uvs.resize(uv_offsets[chunk_count]);
+    result.normals.resize(normal_offsets[chunk_count]);
+    result.indices.resize(index_offsets[chunk_count]);
+
+    pool.parallel_for(static_cast<uint32_t>(chunk_count), [&](uint32_t index, uint32_t)
+    {
+        ObjChunk &chunk = chunks[index];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), result.positions.begin() + position_offsets[index]);
+        std::copy(chunk.uvs.begin(), chunk.uvs.end(), result.uvs.begin() + uv_offsets[index]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), result.normals.begin() + normal_offsets[index]);
+
+        for (uint32_t corner : chunk.relative_corners)
+        {
+            ObjIndex &target = chunk.indices[corner / 3];
+            if (corner % 3 == 0)
+                target.position += static_cast<int32_t>(position_offsets[index]);
+            else if (corner % 3 == 1)
+                target.uv += static_cast<int32_t>(uv_offsets[index]);
+            else
+                target.normal += static_cast<int32_t>(normal_offsets[index]);
+        }
+
+        for (const ObjIndex &corner : chunk.indices)
+        {
+            check_range(corner.position, result.positions.size(), false);
+            check_range(corner.uv, result.uvs.size(), true);
+            check_range(corner.normal, result.normals.size(), true);
+        }
+        std::copy(chunk.indices.begin(), chunk.indices.end(), result.indices.begin() + index_offsets[index]);
+    });
+
+    return result;
+}
+
+
+ObjData parse_obj(const std::string &path, uint32_t thread_count)
+{
+    MappedFile file(path);
+    return parse_obj_text(file.view(), thread_count);
+}
+
+
+Mesh build_mesh(const ObjData &obj)
+{
+    Mesh mesh;
+
+    bool has_uvs = false;
+    bool has_normals = false;
+    bool shared_indices = true;
+    for (const ObjIndex &corner : obj.indices)
+    {
+        has_uvs |= corner.uv >= 0;
+        has_normals |= corner.normal >= 0;
+        shared_indices &= (corner.uv < 0 || corner.uv == corner.position) && (corner.normal < 0 || corner.normal == corner.position);
+    }
+    shared_indices &= (!has_uvs || obj.uvs.size() >= obj.positions.size()) && (!has_normals || obj.normals.size() >= obj.positions.size());
+
+    mesh.indices.resize(obj.indices.size());
+
+    if (shared_indices)
+    {
+        // Attributes are indexed like positions, so the streams can be used as they are.
+        mesh.positions = obj.positions;
+        if (has_uvs)
+            mesh.uvs.assign(obj.uvs.begin(), obj.uvs.begin() + obj.positions.size());
+        if (has_normals)
+            mesh.normals.assign(obj.normals.begin(), obj.normals.begin() + obj.positions.size());
+
+        for (size_t i = 0; i < obj.indices.size(); i++)
+        {
+            mesh.indices[i] = static_cast<uint32_t>(obj.indices[i].position);
+        }
+    }
+    else
+    {
+        // Each position keeps a singly linked list of the uv/normal variants created for it.
+        const uint32_t none = ~0u;
+        std::vector<uint32_t> first_variant(obj.positions.size(), none);
+        std::vector<uint32_t> next_variant;
+        std::vector<ObjIndex> variants;
+
+        mesh.positions.reserve(obj.positions.size());
+        for (size_t i = 0; i < obj.indices.size(); i++)
+        {
+            const ObjIndex &corner = obj.indices[i];
+
+            uint32_t vertex = first_variant[corner.position];
+            while (vertex != none && (variants[vertex].uv != corner.uv || variants[vertex].normal != corner.normal))
+            {
+                vertex = next_variant[vertex];
+            }
+
+            if (vertex == none)
+            {
+                vertex = static_cast<uint32_t>(variants.size());
+                variants.push_back(corner);
+                next_variant.push_back(first_variant[corner.position]);
+                first_variant[corner.position] = vertex;
+
+                mesh.positions.push_back(obj.positions[corner.position]);
+                if (has_uvs)
+                    mesh.uvs.push_back(corner.uv >= 0 ? obj.uvs[corner.uv] : glm::vec2(0.0f));
+                if (has_normals)
+                    mesh.normals.push_back(corner.normal >= 0 ? obj.normals[corner.normal] : glm::vec3(0.0f));
+            }
+
+            mesh.indices[i] = vertex;
+        }
+    }
+
+    mesh.material_ids.assign(mesh.get_triangle_count(), 0);
+    mesh.materials = { Material { sf::Color::White } };
+
+    return mesh;
+}
+
+
+static std::string generate_grid_obj(size_t target_size)
+{
+    std::string text;
+    text.reserve(target_size + 4096);
+
+    // Roughly 150 bytes of text per grid vertex with its uv, normal and face line.
+    int32_t side = std::max<int32_t>(2, static_cast<int32_t>(std::sqrt(static_cast<double>(target_size) / 150.0)));
+    char line[128];
+
+    for (int32_t y = 0; y < side; y++)
+    {
+        for (int32_t x = 0; x < side; x++)
+        {
+            float u = static_cast<float>(x) / (side - 1);
+            float v = static_cast<float>(y) / (side - 1);
+            int length = std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvt %.5f %.5f\nvn 0 0 -1\n", u * 2.0f - 1.0f, v * 2.0f - 1.0f, 0.25f * std::sin(u * 12.0f) * std::cos(v * 9.0f), u, v);
+            text.append(line, length);
+        }
+    }
+    for (int32_t y = 0; y + 1 < side; y++)
+    {
+        for (int32_t x = 0; x + 1 < side; x++)
+        {
+            int32_t i = y * side + x + 1;
+            int length = std::snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", i, i, i, i + 1, i + 1, i + 1, i + side + 1, i + side + 1, i + side + 1, i + side, i + side, i + side);
+            text.append(line, length);
+        }
+    }
+    return text;
+}
+
+
+static void report_throughput(const std::string &name, size_t bytes, const ObjData &data, float seconds)
+{
+    float megabytes = static_cast<float>(bytes) / (1024.0f * 1024.0f);
+    std::cout << name << ": " << megabytes << " MB, " << data.positions.size() << " vertices, " << data.indices.size() / 3 << " triangles, " << seconds * 1000.0f << " ms, " << megabytes / seconds << " MB/s\n";
+}
+
+
+void benchmark_obj_parser(const std::string &path, size_t synthetic_megabytes, uint32_t thread_count)
+{
+    sf::Clock clock;
+
+    {
+        MappedFile file(path);
+        clock.restart();
+        ObjData data = parse_obj_text(file.view(), thread_count);
+        report_throughput(path, file.size(), data, clock.getElapsedTime().asSeconds());
+    }
+
+    if (synthetic_megabytes > 0)
+    {
+        std::string text = generate_grid_obj(synthetic_megabytes * 1024 * 1024);
+        clock.restart();
+        ObjData data = parse_obj_text(text, thread_count);
+        report_throughput("synthetic grid", text.size(), data, clock.getElapsedTime().asSeconds());
+    }
+}
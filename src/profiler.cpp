@@ -0,0 +1,172 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+
+Profiler &Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+
+uint64_t Profiler::now_ns()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+
+Profiler::ThreadBuffer &Profiler::get_thread_buffer()
+{
+    // Each thread registers once, afterwards recording only touches its own buffer.
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer)
+        return *buffer;
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    auto new_buffer = std::make_unique<ThreadBuffer>();
+    new_buffer->thread_id = static_cast<uint32_t>(buffers.size());
+    new_buffer->events = std::make_unique<Event[]>(RING_CAPACITY);
+    buffer = new_buffer.get();
+    buffers.push_back(std::move(new_buffer));
+    return *buffer;
+}
+
+
+void Profiler::push(const Event &event)
+{
+    ThreadBuffer &buffer = get_thread_buffer();
+    uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    buffer.events[head % RING_CAPACITY] = event;
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+
+void Profiler::record_scope(const char *name, uint64_t start_ns, uint64_t end_ns)
+{
+    push(Event { name, start_ns, end_ns - start_ns, 0, false });
+}
+
+
+void Profiler::record_counter(const char *name, int64_t value)
+{
+    if (!is_enabled())
+        return;
+    push(Event { name, now_ns(), 0, value, true });
+}
+
+
+std::vector<std::pair<uint32_t, Profiler::Event>> Profiler::collect_events() const
+{
+    std::vector<std::pair<uint32_t, Event>> events;
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (const auto &buffer : buffers)
+    {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+        for (uint64_t i = first; i < head; i++)
+        {
+            events.emplace_back(buffer->thread_id, buffer->events[i % RING_CAPACITY]);
+        }
+    }
+    return events;
+}
+
+
+void Profiler::write_chrome_trace(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file)
+        throw std::runtime_error("Failed to open " + path);
+
+    std::vector<std::pair<uint32_t, Event>> events = collect_events();
+    std::sort(events.begin(), events.end(), [](const auto &a, const auto &b) { return a.second.start_ns < b.second.start_ns; });
+
+    // Timestamps are in microseconds relative to the creation of the profiler.
+    file << std::fixed << std::setprecision(3);
+    file << "{\"traceEvents\": [\n";
+    bool first = true;
+    for (const auto &[thread_id, event] : events)
+    {
+        if (!first)
+            file << ",\n";
+        first = false;
+
+        double timestamp = static_cast<double>(event.start_ns - std::min(event.start_ns, origin_ns)) / 1000.0;
+        if (event.counter)
+            file << "{\"name\": \"" << event.name << "\", \"ph\": \"C\", \"ts\": " << timestamp << ", \"pid\": 1, \"tid\": " << thread_id << ", \"args\": {\"value\": " << event.value << "}}";
+        else
+            file << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"ts\": " << timestamp << ", \"dur\": " << static_cast<double>(event.duration_ns) / 1000.0 << ", \"pid\": 1, \"tid\": " << thread_id << "}";
+    }
+    file << "\n]}\n";
+}
+
+
+void Profiler::write_summary(std::ostream &out) const
+{
+    struct ScopeSummary
+    {
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+    };
+
+    struct CounterSummary
+    {
+        uint64_t count = 0;
+        int64_t total = 0;
+        int64_t last = 0;
+        uint64_t last_ns = 0;
+    };
+
+    // Keyed by string rather than pointer, the same literal may have several addresses across translation units.
+    std::map<std::string, ScopeSummary> scopes;
+    std::map<std::string, CounterSummary> counters;
+    for (const auto &[thread_id, event] : collect_events())
+    {
+        if (event.counter)
+        {
+            CounterSummary &counter = counters[event.name];
+            counter.count++;
+            counter.total += event.value;
+            if (event.start_ns >= counter.last_ns)
+            {
+                counter.last = event.value;
+                counter.last_ns = event.start_ns;
+            }
+        }
+        else
+        {
+            ScopeSummary &scope = scopes[event.name];
+            scope.count++;
+            scope.total_ns += event.duration_ns;
+            scope.max_ns = std::max(scope.max_ns, event.duration_ns);
+        }
+    }
+
+    // Formatted apart, so the caller's stream keeps its own flags and precision.
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3);
+    text << std::left << std::setw(24) << "marker" << std::right << std::setw(10) << "count" << std::setw(14) << "total ms" << std::setw(12) << "avg ms" << std::setw(12) << "max ms" << "\n";
+    for (const auto &[name, scope] : scopes)
+    {
+        double total = static_cast<double>(scope.total_ns) / 1e6;
+        text << std::left << std::setw(24) << name << std::right << std::setw(10) << scope.count << std::setw(14) << total << std::setw(12) << total / static_cast<double>(scope.count) << std::setw(12) << static_cast<double>(scope.max_ns) / 1e6 << "\n";
+    }
+
+    if (!counters.empty())
+        text << std::left << std::setw(24) << "counter" << std::right << std::setw(10) << "count" << std::setw(14) << "last" << std::setw(16) << "avg" << "\n";
+    for (const auto &[name, counter] : counters)
+    {
+        text << std::left << std::setw(24) << name << std::right << std::setw(10) << counter.count << std::setw(14) << counter.last << std::setw(16) << static_cast<double>(counter.total) / static_cast<double>(counter.count) << "\n";
+    }
+
+    out << text.str();
+}
@@ -0,0 +1,1764 @@
+#include "renderer.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#ifdef RASTERIZER_X86
+#include <emmintrin.h>
+#endif
+
+
+// Vertices are snapped to 1/16 pixel, edge functions are evaluated exactly in 64-bit integers.
+static constexpr int64_t SUBPIXEL_BITS = 4;
+static constexpr int64_t SUBPIXEL_STEP = 1 << SUBPIXEL_BITS;
+static constexpr int64_t SUBPIXEL_HALF = SUBPIXEL_STEP / 2;
+static constexpr float MAX_SCREEN_COORDINATE = static_cast<float>(1 << 22);
+
+// Instances covering at least this share of the screen are drawn in the occluder pass.
+static constexpr float OCCLUDER_MIN_SCREEN_SHARE = 1.0f / 256.0f;
+
+// Meshes with at least this many vertices keep their transformed vertices per instance across frames.
+static constexpr size_t VERTEX_CACHE_MIN_VERTICES = 1024;
+
+// Instances of one model handed to a thread at once.
+static constexpr uint32_t MAX_BATCH_SIZE = 64;
+
+// Instances with more meshlets than this are split into batches of this many, so one large mesh still spreads over all threads.
+static constexpr uint32_t MAX_BATCH_MESHLETS = 8;
+
+// Triangles a level of detail should spend per pixel of the projected bounding sphere, one per few pixels
+// is about where smaller triangles stop adding visible detail.
+static constexpr float LOD_PIXELS_PER_TRIANGLE = 6.0f;
+
+// An instance keeps its level until its triangle budget moved this factor past the point of switching, which
+// stops levels from flickering at the boundary.
+static constexpr float LOD_HYSTERESIS = 1.25f;
+
+// Relative margin on the closest depth of a triangle, far above the float error of span interpolation.
+static constexpr float DEPTH_MARGIN = 1.0f / 1024.0f;
+
+// The usual rotated 4x and 8x sample patterns, offsets from the pixel center in 1/16 pixel with y down.
+static constexpr int64_t SAMPLE_PATTERN_1[1][2] = { { 0, 0 } };
+static constexpr int64_t SAMPLE_PATTERN_4[4][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+static constexpr int64_t SAMPLE_PATTERN_8[8][2] = { { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } };
+
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+static int64_t floor_div(int64_t numerator, int64_t denominator)
+{
+    int64_t quotient = numerator / denominator;
+    return (numerator % denominator != 0 && numerator < 0) ? quotient - 1 : quotient;
+}
+
+
+static int64_t ceil_div(int64_t numerator, int64_t denominator)
+{
+    int64_t quotient = numerator / denominator;
+    return (numerator % denominator != 0 && numerator > 0) ? quotient + 1 : quotient;
+}
+
+
+// Calls function with the sample count, 4 or 8, as a std::integral_constant.
+template <typename Function>
+static void dispatch_sample_count(uint32_t count, Function &&function)
+{
+    if (count == 8)
+        function(std::integral_constant<uint32_t, 8> {});
+    else
+        function(std::integral_constant<uint32_t, 4> {});
+}
+
+
+// Rounded mean of count colors per channel, count is 4 or 8.
+static uint32_t average_samples(const uint32_t *colors, uint32_t count)
+{
+    int32_t shift = count == 8 ? 3 : 2;
+#ifdef RASTERIZER_X86
+    // Channels widened to 16 bits, at most 8 * 255 per lane, then the two halves of the sum folded together.
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(colors + i));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_unpacklo_epi8(samples, zero), _mm_unpackhi_epi8(samples, zero)));
+    }
+    sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srl_epi16(_mm_add_epi16(sum, _mm_set1_epi16(static_cast<int16_t>(count / 2))), _mm_cvtsi32_si128(shift));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)));
+#else
+    uint32_t result = 0;
+    for (int32_t channel = 0; channel < 32; channel += 8)
+    {
+        uint32_t sum = count / 2;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            sum += (colors[i] >> channel) & 0xff;
+        }
+        result |= (sum >> shift) << channel;
+    }
+    return result;
+#endif
+}
+
+
+Renderer::Renderer(int32_t width, int32_t height, uint32_t thread_count, DepthFormat depth_format) : WIDTH(width), HEIGHT(height), DEPTH_FORMAT(depth_format), DEPTH_SIZE(get_depth_format_size(depth_format)), depth_pyramid(width, height, TILE_SIZE, depth_format), thread_pool(thread_count)
+{
+    // Both start zeroed, which the initial tile states record as uniform.
+    tiles_x = (WIDTH + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (HEIGHT + TILE_SIZE - 1) / TILE_SIZE;
+
+    color_buffer = create_color_buffer();
+    depth_buffer = std::make_unique<uint8_t[]>(static_cast<size_t>(WIDTH) * HEIGHT * DEPTH_SIZE);
+    depth_tiles.resize(tiles_x * tiles_y);
+
+    // Maps view space onto the viewport at distance d, w = z and clip z = 1 so that depth is 1/w.
+    projection = glm::mat4(0.0f);
+    projection[0][0] = 2.0f * d / static_cast<float>(viewport_width);
+    projection[1][1] = 2.0f * d / static_cast<float>(viewport_height);
+    projection[2][3] = 1.0f;
+    projection[3][2] = 1.0f;
+    projection_version = next_version();
+
+    // Guard band of 2^16 pixels around the screen, well inside the range setup_triangle accepts.
+    float guard_band = static_cast<float>(1 << 16);
+    clip_planes = ClipPlanes { NEAR_W, 1.0f + guard_band / (WIDTH / 2.0f), 1.0f + guard_band / (HEIGHT / 2.0f) };
+
+    screen_mapping = ScreenMapping { WIDTH / 2.0f, -HEIGHT / 2.0f, static_cast<float>(WIDTH / 2) + 0.5f, static_cast<float>((HEIGHT + 1) / 2) - 0.5f };
+
+    contexts.resize(thread_pool.get_thread_count());
+    for (auto &context : contexts)
+    {
+        context.bins.resize(tiles_x * tiles_y);
+        context.bin_runs.resize(tiles_x * tiles_y);
+    }
+    while ((1u << context_bits) < contexts.size())
+    {
+        context_bits++;
+    }
+}
+
+
+void Renderer::set_visibility_buffer(bool enabled)
+{
+    if (!enabled)
+    {
+        visibility_buffer.reset();
+        visibility_tiles.clear();
+        return;
+    }
+    if (visibility_buffer)
+        return;
+    if (sample_count > 1)
+        throw std::runtime_error("The visibility buffer can't be combined with multisampling.");
+
+    size_t size = static_cast<size_t>(WIDTH) * HEIGHT;
+    visibility_buffer = std::make_unique<uint32_t[]>(size);
+    std::fill(visibility_buffer.get(), visibility_buffer.get() + size, NO_TRIANGLE);
+    visibility_tiles.assign(tiles_x * tiles_y, 0);
+}
+
+
+void Renderer::set_sample_count(uint32_t count)
+{
+    if (count != 1 && count != 4 && count != 8)
+        throw std::runtime_error("Unsupported sample count " + std::to_string(count) + ", expected 1, 4 or 8.");
+    if (count > 1 && visibility_buffer)
+        throw std::runtime_error("Multisampling can't be combined with the visibility buffer.");
+    if (count == sample_count)
+        return;
+
+    // Split pixels are resolved while their samples still exist, the depth of the old samples is dropped.
+    get_pixels();
+    clear_depth_buffer();
+
+    sample_count = count;
+    const int64_t (*pattern)[2] = count == 8 ? SAMPLE_PATTERN_8 : (count == 4 ? SAMPLE_PATTERN_4 : SAMPLE_PATTERN_1);
+    sample_extent = 0;
+    for (uint32_t s = 0; s < count; s++)
+    {
+        sample_x[s] = pattern[s][0];
+        sample_y[s] = pattern[s][1];
+        sample_extent = std::max({ sample_extent, std::abs(sample_x[s]), std::abs(sample_y[s]) });
+    }
+
+    if (count == 1)
+    {
+        sample_depth.reset();
+        depth_written.reset();
+        sample_colors.reset();
+        split_pixels.reset();
+        split_tiles.clear();
+        return;
+    }
+
+    // No pixel starts written or split, so the samples need no initial values.
+    size_t size = static_cast<size_t>(WIDTH) * HEIGHT;
+    sample_depth = std::make_unique<uint8_t[]>(size * count * DEPTH_SIZE);
+    depth_written = std::make_unique<uint8_t[]>(size);
+    sample_colors = std::make_unique<uint32_t[]>(size * count);
+    split_pixels = std::make_unique<uint8_t[]>(size);
+    split_tiles.assign(tiles_x * tiles_y, 0);
+}
+
+
+void Renderer::clear(const sf::Color &color)
+{
+    auto start = std::chrono::steady_clock::now();
+    fill(color);
+    clear_depth_buffer();
+    timings.clear_ms = elapsed_ms(start);
+}
+
+
+void Renderer::clear_depth_buffer()
+{
+    PROFILE_SCOPE("clear_depth_buffer");
+    for (auto &tile : depth_tiles)
+    {
+        tile.pending = !tile.uniform;
+    }
+    depth_pyramid.clear();
+}
+
+
+void Renderer::fill(const sf::Color &color)
+{
+    PROFILE_SCOPE("fill");
+    clear_color = pack_color(color);
+    for (uint32_t tile = 0; tile < color_buffer.tiles.size(); tile++)
+    {
+        // Split pixels are reset with the clear of their tile, even when the tile holds the clear color after a swap.
+        ColorBuffer::Tile &state = color_buffer.tiles[tile];
+        state.pending = !state.uniform || state.uniform_color != clear_color || (!split_tiles.empty() && split_tiles[tile]);
+    }
+}
+
+
+void Renderer::fill_tile_color(uint32_t tile, uint32_t color)
+{
+    Rect rect = tile_rect(static_cast<int32_t>(tile % tiles_x), static_cast<int32_t>(tile / tiles_x));
+    uint32_t *rows = reinterpret_cast<uint32_t *>(color_buffer.pixels.get());
+    for (int32_t y = rect.min_y; y <= rect.max_y; y++)
+    {
+        std::fill(rows + static_cast<size_t>(y) * WIDTH + rect.min_x, rows + static_cast<size_t>(y) * WIDTH + rect.max_x + 1, color);
+    }
+
+    if (split_tiles.empty() || !split_tiles[tile])
+        return;
+    for (int32_t y = rect.min_y; y <= rect.max_y; y++)
+    {
+        std::memset(split_pixels.get() + static_cast<size_t>(y) * WIDTH + rect.min_x, 0, static_cast<size_t>(rect.max_x - rect.min_x + 1));
+    }
+    split_tiles[tile] = 0;
+}
+
+
+void Renderer::fill_tile_depth(uint32_t tile)
+{
+    Rect rect = tile_rect(static_cast<int32_t>(tile % tiles_x), static_cast<int32_t>(tile / tiles_x));
+    // Every format clears to all zero bits.
+    for (int32_t y = rect.min_y; y <= rect.max_y; y++)
+    {
+        std::memset(depth_at(static_cast<size_t>(y) * WIDTH + rect.min_x), 0, static_cast<size_t>(rect.max_x - rect.min_x + 1) * DEPTH_SIZE);
+        if (sample_count > 1)
+            std::memset(depth_written.get() + static_cast<size_t>(y) * WIDTH + rect.min_x, 0, static_cast<size_t>(rect.max_x - rect.min_x + 1));
+    }
+}
+
+
+void Renderer::resolve_samples(uint32_t tile)
+{
+    Rect rect = tile_rect(static_cast<int32_t>(tile % tiles_x), static_cast<int32_t>(tile / tiles_x));
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(color_buffer.pixels.get());
+    for (int32_t y = rect.min_y; y <= rect.max_y; y++)
+    {
+        size_t offset = static_cast<size_t>(y) * WIDTH;
+        for (int32_t x = rect.min_x; x <= rect.max_x;)
+        {
+            // Split pixels lie along edges, most runs of 8 flags have none.
+            uint64_t flags = 0;
+            if (x + 8 <= rect.max_x + 1)
+            {
+                std::memcpy(&flags, split_pixels.get() + offset + x, sizeof(flags));
+                if (flags == 0)
+                {
+                    x += 8;
+                    continue;
+                }
+            }
+
+            if (split_pixels[offset + x])
+                pixels[offset + x] = average_samples(sample_colors.get() + (offset + x) * sample_count, sample_count);
+            x++;
+        }
+    }
+}
+
+
+void Renderer::materialize_tile(uint32_t tile)
+{
+    ColorBuffer::Tile &color = color_buffer.tiles[tile];
+    if (color.pending)
+        fill_tile_color(tile, clear_color);
+    color = ColorBuffer::Tile { false, false, 0 };
+
+    DepthTile &depth = depth_tiles[tile];
+    if (depth.pending)
+        fill_tile_depth(tile);
+    depth = DepthTile { false, false };
+}
+
+
+const uint8_t *Renderer::get_pixels()
+{
+    // Untouched tiles resolve straight to the clear color and stay uniform, so a later clear to the same color is free.
+    // Drawn tiles only need work when they have split pixels, the others already hold their final colors.
+    thread_pool.parallel_for(static_cast<uint32_t>(color_buffer.tiles.size()), [&](uint32_t tile, uint32_t)
+    {
+        ColorBuffer::Tile &state = color_buffer.tiles[tile];
+        if (!state.pending)
+        {
+            if (!split_tiles.empty() && split_tiles[tile])
+                resolve_samples(tile);
+            return;
+        }
+        fill_tile_color(tile, clear_color);
+        state = ColorBuffer::Tile { false, true, clear_color };
+    });
+    return color_buffer.pixels.get();
+}
+
+
+void Renderer::read_depth(std::vector<float> &depth)
+{
+    thread_pool.parallel_for(static_cast<uint32_t>(depth_tiles.size()), [&](uint32_t tile, uint32_t)
+    {
+        DepthTile &state = depth_tiles[tile];
+        if (!state.pending)
+            return;
+        fill_tile_depth(tile);
+        state = DepthTile { false, true };
+    });
+
+    depth.resize(static_cast<size_t>(WIDTH) * HEIGHT);
+    decode_depth(DEPTH_FORMAT, depth_buffer.get(), depth.size(), depth.data());
+}
+
+
+ColorBuffer Renderer::create_color_buffer() const
+{
+    ColorBuffer buffer;
+    buffer.pixels = std::make_unique<uint8_t[]>(static_cast<size_t>(WIDTH) * HEIGHT * 4);
+    buffer.tiles.resize(tiles_x * tiles_y);
+    return buffer;
+}
+
+
+void Renderer::swap_color_buffer(ColorBuffer &buffer)
+{
+    if (buffer.tiles.size() != color_buffer.tiles.size())
+        throw std::runtime_error("Color buffer does not match the renderer size.");
+
+    get_pixels();
+    std::swap(color_buffer, buffer);
+}
+
+
+template <typename Varyings, typename Shader>
+void Renderer::shade_triangle(const TriangleSetup &triangle, const VaryingPlanes<Varyings> &planes, const Shader &shader, const Rect &rect, PrimitiveStats &stats)
+{
+    // One loop per depth format, with the shader inlined into it.
+    dispatch_depth_format(DEPTH_FORMAT, [&](auto format)
+    {
+        using Format = decltype(format);
+        uint32_t *pixels = reinterpret_cast<uint32_t *>(color_buffer.pixels.get());
+
+        VaryingSpan<Varyings> span;
+        if (sample_count > 1)
+        {
+            // Shaded once per pixel at its center, like the single sample path.
+            dispatch_sample_count(sample_count, [&](auto samples)
+            {
+                stats.fragments += walk_sample_spans(triangle, rect, [&](int64_t y, int64_t x_begin, int64_t x_end, int64_t inner_begin, int64_t inner_end, double offset_x, double offset_y)
+                {
+                    setup_varying_span(planes, triangle.depth, triangle.depth_dx, triangle.depth_dy, offset_x, offset_y, span);
+                    stats.shaded += shade_sample_span<Format, decltype(samples)::value>(triangle, y, x_begin, x_end, inner_begin, inner_end, span.depth, [&](float t, float inv_w)
+                    {
+                        return shade_pixel(span, t, inv_w, shader);
+                    });
+                });
+            });
+            return;
+        }
+
+        stats.fragments += walk_spans(triangle, rect, [&](int64_t y, int64_t x_begin, int64_t x_end, double offset_x, double offset_y)
+        {
+            size_t offset = static_cast<size_t>(y) * WIDTH + static_cast<size_t>(x_begin);
+            setup_varying_span(planes, triangle.depth, triangle.depth_dx, triangle.depth_dy, offset_x, offset_y, span);
+            stats.shaded += static_cast<uint64_t>(shade_span<Format>(pixels + offset, depth_at(offset), static_cast<int32_t>(x_end - x_begin), span, shader));
+        });
+    });
+}
+
+
+template <typename Varyings, typename Shader>
+void Renderer::shade_visible(const TriangleSetup &triangle, const VaryingPlanes<Varyings> &planes, const Shader &shader, int32_t y, int32_t x_begin, int32_t x_end)
+{
+    // Pixel center offsets from vertex 0 as walk_spans computes them.
+    double offset_x = static_cast<double>(x_begin * SUBPIXEL_STEP + SUBPIXEL_HALF - triangle.x0) / SUBPIXEL_STEP;
+    double offset_y = static_cast<double>(y * SUBPIXEL_STEP + SUBPIXEL_HALF - triangle.y0) / SUBPIXEL_STEP;
+
+    VaryingSpan<Varyings> span;
+    setup_varying_span(planes, triangle.depth, triangle.depth_dx, triangle.depth_dy, offset_x, offset_y, span);
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(color_buffer.pixels.get());
+    shade_visible_span(pixels + static_cast<size_t>(y) * WIDTH + x_begin, x_end - x_begin, span, shader);
+}
+
+
+Renderer::SetupResult Renderer::setup_triangle(const glm::vec2 &v0, const glm::vec2 &v1, const glm::vec2 &v2, float d0, float d1, float d2, const sf::Color &color, bool cull_back_faces, TriangleSetup &triangle)
+{
+    // Also rejects NaN and infinity coming from vertices projected at z == 0.
+    for (const glm::vec2 &v : {v0, v1, v2})
+    {
+        if (!(std::abs(v.x) < MAX_SCREEN_COORDINATE && std::abs(v.y) < MAX_SCREEN_COORDINATE))
+            return SetupResult::Rejected;
+    }
+
+    int64_t x0 = std::llround(v0.x * SUBPIXEL_STEP);
+    int64_t y0 = std::llround(v0.y * SUBPIXEL_STEP);
+    int64_t x1 = std::llround(v1.x * SUBPIXEL_STEP);
+    int64_t y1 = std::llround(v1.y * SUBPIXEL_STEP);
+    int64_t x2 = std::llround(v2.x * SUBPIXEL_STEP);
+    int64_t y2 = std::llround(v2.y * SUBPIXEL_STEP);
+
+    int64_t area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+    if (area == 0)
+        return SetupResult::Rejected;
+    // Meshes wind front faces so that their area is positive with y pointing down.
+    if (cull_back_faces && area < 0)
+        return SetupResult::BackFacing;
+    triangle.flipped = area < 0;
+    if (area < 0)
+    {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+        std::swap(d1, d2);
+        area = -area;
+    }
+
+    // Pixels with a sample inside, their centers with a single sample.
+    int64_t min_x = std::max<int64_t>(0, ceil_div(std::min({x0, x1, x2}) - SUBPIXEL_HALF - sample_extent, SUBPIXEL_STEP));
+    int64_t max_x = std::min<int64_t>(WIDTH - 1, floor_div(std::max({x0, x1, x2}) - SUBPIXEL_HALF + sample_extent, SUBPIXEL_STEP));
+    int64_t min_y = std::max<int64_t>(0, ceil_div(std::min({y0, y1, y2}) - SUBPIXEL_HALF - sample_extent, SUBPIXEL_STEP));
+    int64_t max_y = std::min<int64_t>(HEIGHT - 1, floor_div(std::max({y0, y1, y2}) - SUBPIXEL_HALF + sample_extent, SUBPIXEL_STEP));
+    if (min_x > max_x || min_y > max_y)
+        return SetupResult::Rejected;
+
+    triangle.bounds = Rect { static_cast<int32_t>(min_x), static_cast<int32_t>(min_y), static_cast<int32_t>(max_x), static_cast<int32_t>(max_y) };
+
+    // Edge i is opposite to vertex i, E(x, y) = a * x + b * y + c is positive inside.
+    int64_t a[3] = { y1 - y2, y2 - y0, y0 - y1 };
+    int64_t b[3] = { x2 - x1, x0 - x2, x1 - x0 };
+    int64_t c[3] = { -a[0] * x1 - b[0] * y1, -a[1] * x2 - b[1] * y2, -a[2] * x0 - b[2] * y0 };
+
+    // Top-left fill rule: pixels exactly on an edge belong to it only if it is a top or a left edge.
+    for (int32_t i = 0; i < 3; i++)
+    {
+        bool top_left = a[i] > 0 || (a[i] == 0 && b[i] > 0);
+
+        triangle.a[i] = a[i];
+        triangle.b[i] = b[i];
+        triangle.c[i] = c[i] + (top_left ? 0 : -1);
+    }
+
+    // Attributes are planes over the pixel grid, evaluated relative to v0 to keep precision.
+    double inv_area = static_cast<double>(SUBPIXEL_STEP) / static_cast<double>(area);
+    triangle.inv_area = inv_area;
+    triangle.x0 = x0;
+    triangle.y0 = y0;
+    triangle.depth = d0;
+    triangle.max_depth = encode_depth_units(DEPTH_FORMAT, std::max({d0, d1, d2}) * (1.0f + DEPTH_MARGIN));
+    triangle.depth_dx = (a[0] * static_cast<double>(d0) + a[1] * static_cast<double>(d1) + a[2] * static_cast<double>(d2)) * inv_area;
+    triangle.depth_dy = (b[0] * static_cast<double>(d0) + b[1] * static_cast<double>(d1) + b[2] * static_cast<double>(d2)) * inv_area;
+    triangle.min_inv_w = std::min({d0, d1, d2});
+    triangle.max_inv_w = std::max({d0, d1, d2});
+    triangle.color = color;
+    triangle.shading = Shading::Flat;
+    triangle.varyings = 0;
+
+    return SetupResult::Accepted;
+}
+
+
+template <typename SpanFunction>
+uint64_t Renderer::walk_spans(const TriangleSetup &triangle, const Rect &rect, SpanFunction &&span) const
+{
+    int64_t min_x = std::max(triangle.bounds.min_x, rect.min_x);
+    int64_t max_x = std::min(triangle.bounds.max_x, rect.max_x);
+    int64_t min_y = std::max(triangle.bounds.min_y, rect.min_y);
+    int64_t max_y = std::min(triangle.bounds.max_y, rect.max_y);
+    if (min_x > max_x || min_y > max_y)
+        return 0;
+
+    uint64_t fragments = 0;
+    int64_t row[3];
+    int64_t row_step[3];
+    int64_t column_step[3];
+    for (int32_t i = 0; i < 3; i++)
+    {
+        row[i] = triangle.a[i] * SUBPIXEL_HALF + triangle.b[i] * (min_y * SUBPIXEL_STEP + SUBPIXEL_HALF) + triangle.c[i];
+        row_step[i] = triangle.b[i] * SUBPIXEL_STEP;
+        column_step[i] = triangle.a[i] * SUBPIXEL_STEP;
+    }
+
+    for (int64_t y = min_y; y <= max_y; y++)
+    {
+        int64_t x_begin = min_x;
+        int64_t x_end = max_x;
+        for (int32_t i = 0; i < 3; i++)
+        {
+            if (column_step[i] > 0)
+                x_begin = std::max(x_begin, ceil_div(-row[i], column_step[i]));
+            else if (column_step[i] < 0)
+                x_end = std::min(x_end, floor_div(row[i], -column_step[i]));
+            else if (row[i] < 0)
+                x_end = x_begin - 1;
+
+            row[i] += row_step[i];
+        }
+
+        if (x_begin > x_end)
+            continue;
+        fragments += static_cast<uint64_t>(x_end - x_begin + 1);
+
+        double offset_x = static_cast<double>(x_begin * SUBPIXEL_STEP + SUBPIXEL_HALF - triangle.x0) / SUBPIXEL_STEP;
+        double offset_y = static_cast<double>(y * SUBPIXEL_STEP + SUBPIXEL_HALF - triangle.y0) / SUBPIXEL_STEP;
+        span(y, x_begin, x_end + 1, offset_x, offset_y);
+    }
+    return fragments;
+}
+
+
+void Renderer::edge_sample_range(const TriangleSetup &triangle, int32_t i, int64_t &lowest, int64_t &highest) const
+{
+    lowest = std::numeric_limits<int64_t>::max();
+    highest = std::numeric_limits<int64_t>::min();
+    for (uint32_t s = 0; s < sample_count; s++)
+    {
+        int64_t change = triangle.a[i] * sample_x[s] + triangle.b[i] * sample_y[s];
+        lowest = std::min(lowest, change);
+        highest = std::max(highest, change);
+    }
+}
+
+
+template <typename SpanFunction>
+uint64_t Renderer::walk_sample_spans(const TriangleSetup &triangle, const Rect &rect, SpanFunction &&span) const
+{
+    int64_t min_x = std::max(triangle.bounds.min_x, rect.min_x);
+    int64_t max_x = std::min(triangle.bounds.max_x, rect.max_x);
+    int64_t min_y = std::max(triangle.bounds.min_y, rect.min_y);
+    int64_t max_y = std::min(triangle.bounds.max_y, rect.max_y);
+    if (min_x > max_x || min_y > max_y)
+        return 0;
+
+    // Edge values at pixel centers, shifted to the sample where each edge is largest for the pixels with any sample
+    // inside and to the one where it is smallest for those with all of them inside.
+    uint64_t fragments = 0;
+    int64_t row[3];
+    int64_t row_step[3];
+    int64_t column_step[3];
+    int64_t lowest[3];
+    int64_t highest[3];
+    for (int32_t i = 0; i < 3; i++)
+    {
+        row[i] = triangle.a[i] * SUBPIXEL_HALF + triangle.b[i] * (min_y * SUBPIXEL_STEP + SUBPIXEL_HALF) + triangle.c[i];
+        row_step[i] = triangle.b[i] * SUBPIXEL_STEP;
+        column_step[i] = triangle.a[i] * SUBPIXEL_STEP;
+        edge_sample_range(triangle, i, lowest[i], highest[i]);
+    }
+
+    for (int64_t y = min_y; y <= max_y; y++)
+    {
+        int64_t x_begin = min_x;
+        int64_t x_end = max_x;
+        int64_t inner_begin = min_x;
+        int64_t inner_end = max_x;
+        for (int32_t i = 0; i < 3; i++)
+        {
+            if (column_step[i] > 0)
+            {
+                x_begin = std::max(x_begin, ceil_div(-row[i] - highest[i], column_step[i]));
+                inner_begin = std::max(inner_begin, ceil_div(-row[i] - lowest[i], column_step[i]));
+            }
+            else if (column_step[i] < 0)
+            {
+                x_end = std::min(x_end, floor_div(row[i] + highest[i], -column_step[i]));
+                inner_end = std::min(inner_end, floor_div(row[i] + lowest[i], -column_step[i]));
+            }
+            else
+            {
+                if (row[i] + highest[i] < 0)
+                    x_end = x_begin - 1;
+                if (row[i] + lowest[i] < 0)
+                    inner_end = inner_begin - 1;
+            }
+
+            row[i] += row_step[i];
+        }
+
+        if (x_begin > x_end)
+            continue;
+        fragments += static_cast<uint64_t>(x_end - x_begin + 1);
+
+        inner_begin = std::max(inner_begin, x_begin);
+        inner_end = std::max(std::min(inner_end, x_end) + 1, inner_begin);
+
+        double offset_x = static_cast<double>(x_begin * SUBPIXEL_STEP + SUBPIXEL_HALF - triangle.x0) / SUBPIXEL_STEP;
+        double offset_y = static_cast<double>(y * SUBPIXEL_STEP + SUBPIXEL_HALF - triangle.y0) / SUBPIXEL_STEP;
+        span(y, x_begin, x_end + 1, inner_begin, inner_end, offset_x, offset_y);
+    }
+    return fragments;
+}
+
+
+uint32_t Renderer::coverage_mask(const TriangleSetup &triangle, int64_t x, int64_t y) const
+{
+    int64_t center[3];
+    for (int32_t i = 0; i < 3; i++)
+    {
+        center[i] = triangle.a[i] * (x * SUBPIXEL_STEP + SUBPIXEL_HALF) + triangle.b[i] * (y * SUBPIXEL_STEP + SUBPIXEL_HALF) + triangle.c[i];
+    }
+
+    uint32_t mask = 0;
+    for (uint32_t s = 0; s < sample_count; s++)
+    {
+        bool inside = true;
+        for (int32_t i = 0; i < 3; i++)
+        {
+            inside = inside && center[i] + triangle.a[i] * sample_x[s] + triangle.b[i] * sample_y[s] >= 0;
+        }
+        mask |= inside ? 1u << s : 0u;
+    }
+    return mask;
+}
+
+
+template <typename Format, uint32_t SAMPLES, typename ShadeFunction>
+uint32_t Renderer::shade_sample_span(const TriangleSetup &triangle, int64_t y, int64_t x_begin, int64_t x_end, int64_t inner_begin, int64_t inner_end, float depth, ShadeFunction &&shade)
+{
+    float sample_depth_offsets[SAMPLES];
+    for (uint32_t s = 0; s < SAMPLES; s++)
+    {
+        sample_depth_offsets[s] = static_cast<float>((triangle.depth_dx * sample_x[s] + triangle.depth_dy * sample_y[s]) / SUBPIXEL_STEP);
+    }
+
+    uint32_t all_samples = (1u << SAMPLES) - 1;
+    float depth_step = static_cast<float>(triangle.depth_dx);
+    uint32_t written = 0;
+    for (int64_t x = x_begin; x < x_end; x++)
+    {
+        // Only pixels on an edge test their samples one by one.
+        uint32_t mask = x >= inner_begin && x < inner_end ? all_samples : coverage_mask(triangle, x, y);
+        if (mask == 0)
+            continue;
+
+        float t = static_cast<float>(x - x_begin);
+        float inv_w = depth + depth_step * t;
+        written += write_samples<Format, SAMPLES>(static_cast<size_t>(y) * WIDTH + static_cast<size_t>(x), mask, inv_w, sample_depth_offsets, [&] { return shade(t, inv_w); }) ? 1 : 0;
+    }
+    return written;
+}
+
+
+template <typename Format, uint32_t SAMPLES, typename ShadeFunction>
+inline bool Renderer::write_samples(size_t offset, uint32_t mask, float depth, const float *sample_depth_offsets, ShadeFunction &&shade)
+{
+    using Storage = typename Format::Storage;
+    Storage *samples = reinterpret_cast<Storage *>(sample_depth.get()) + offset * SAMPLES;
+
+    // Without branches, so the loop can become a few vector compares. Every sample is stored, which makes the
+    // pixel written.
+    bool written = depth_written[offset] != 0;
+    uint32_t passed = 0;
+    for (uint32_t s = 0; s < SAMPLES; s++)
+    {
+        Storage stored = written ? samples[s] : Storage(0);
+        Storage value = Format::encode(depth + sample_depth_offsets[s]);
+        bool pass = (mask & (1u << s)) != 0 && stored < value;
+        samples[s] = pass ? value : stored;
+        passed |= static_cast<uint32_t>(pass) << s;
+    }
+    depth_written[offset] = 1;
+    if (!passed)
+        return false;
+
+    uint32_t color = shade();
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(color_buffer.pixels.get());
+    uint32_t *colors = sample_colors.get() + offset * SAMPLES;
+    if (passed == (1u << SAMPLES) - 1)
+    {
+        // Every sample has the new color, the pixel holds it alone again.
+        pixels[offset] = color;
+        split_pixels[offset] = 0;
+    }
+    else if (split_pixels[offset])
+    {
+        for (uint32_t s = 0; s < SAMPLES; s++)
+        {
+            if (passed & (1u << s))
+                colors[s] = color;
+        }
+    }
+    else if (pixels[offset] != color)
+    {
+        for (uint32_t s = 0; s < SAMPLES; s++)
+        {
+            colors[s] = passed & (1u << s) ? color : pixels[offset];
+        }
+        split_pixels[offset] = 1;
+        split_tiles[(offset / WIDTH / TILE_SIZE) * tiles_x + (offset % WIDTH) / TILE_SIZE] = 1;
+    }
+
+    Storage farthest = samples[0];
+    for (uint32_t s = 1; s < SAMPLES; s++)
+    {
+        farthest = std::min(farthest, samples[s]);
+    }
+    *static_cast<Storage *>(depth_at(offset)) = farthest;
+    return true;
+}
+
+
+void Renderer::rasterize_triangle(const TriangleSetup &triangle, const Rect &rect, PrimitiveStats &stats)
+{
+    if (sample_count > 1)
+    {
+        uint32_t color = pack_color(triangle.color);
+        dispatch_depth_format(DEPTH_FORMAT, [&](auto format)
+        {
+            dispatch_sample_count(sample_count, [&](auto samples)
+            {
+                stats.fragments += walk_sample_spans(triangle, rect, [&](int64_t y, int64_t x_begin, int64_t x_end, int64_t inner_begin, int64_t inner_end, double offset_x, double offset_y)
+                {
+                    float depth = static_cast<float>(triangle.depth + triangle.depth_dx * offset_x + triangle.depth_dy * offset_y);
+                    stats.shaded += shade_sample_span<decltype(format), decltype(samples)::value>(triangle, y, x_begin, x_end, inner_begin, inner_end, depth, [&](float, float) { return color; });
+                });
+            });
+        });
+        return;
+    }
+
+    stats.fragments += walk_spans(triangle, rect, [&](int64_t y, int64_t x_begin, int64_t x_end, double offset_x, double offset_y)
+    {
+        float depth = static_cast<float>(triangle.depth + triangle.depth_dx * offset_x + triangle.depth_dy * offset_y);
+        stats.shaded += draw_span(static_cast<int32_t>(y), static_cast<int32_t>(x_begin), static_cast<int32_t>(x_end), depth, static_cast<float>(triangle.depth_dx), triangle.color);
+    });
+}
+
+
+uint32_t Renderer::draw_span(int32_t y, int32_t x_begin, int32_t x_end, float depth, float depth_step, const sf::Color &color)
+{
+    size_t offset = static_cast<size_t>(y) * WIDTH + x_begin;
+    return static_cast<uint32_t>(span_kernels->flat[static_cast<size_t>(DEPTH_FORMAT)](reinterpret_cast<uint32_t *>(color_buffer.pixels.get()) + offset, depth_at(offset), x_end - x_begin, depth, depth_step, pack_color(color)));
+}
+
+
+void Renderer::rasterize_visibility(const TriangleSetup &triangle, uint32_t id, const Rect &rect, PrimitiveStats &stats)
+{
+    // The flat kernels store any 32-bit value, here the id in place of a color.
+    FlatSpanKernel kernel = span_kernels->flat[static_cast<size_t>(DEPTH_FORMAT)];
+    stats.fragments += walk_spans(triangle, rect, [&](int64_t y, int64_t x_begin, int64_t x_end, double offset_x, double offset_y)
+    {
+        size_t offset = static_cast<size_t>(y) * WIDTH + static_cast<size_t>(x_begin);
+        float depth = static_cast<float>(triangle.depth + triangle.depth_dx * offset_x + triangle.depth_dy * offset_y);
+        stats.shaded += static_cast<uint64_t>(kernel(visibility_buffer.get() + offset, depth_at(offset), static_cast<int32_t>(x_end - x_begin), depth, static_cast<float>(triangle.depth_dx), id));
+    });
+}
+
+
+FrameTimings Renderer::get_frame_timings() const
+{
+    FrameTimings result = timings;
+    for (const auto &context : contexts)
+    {
+        result.transform_ms += context.transform_ms;
+        result.setup_ms += context.setup_ms;
+    }
+    return result;
+}
+
+
+PrimitiveStats Renderer::get_primitive_stats() const
+{
+    PrimitiveStats total;
+    total.instances = instance_count;
+    total.instances_culled = instance_count - visible_instances.size();
+    total.instances_occluded = instances_occluded;
+    total.instances_reduced_lod = instances_reduced_lod;
+    total.lights = view_lights.size();
+    for (const auto &context : contexts)
+    {
+        total.meshlets += context.stats.meshlets;
+        total.meshlets_frustum_culled += context.stats.meshlets_frustum_culled;
+        total.meshlets_backface_culled += context.stats.meshlets_backface_culled;
+        total.submitted += context.stats.submitted;
+        total.frustum_culled += context.stats.frustum_culled;
+        total.backface_culled += context.stats.backface_culled;
+        total.clipped += context.stats.clipped;
+        total.rasterized += context.stats.rasterized;
+        total.tile_triangles += context.stats.tile_triangles;
+        total.tile_triangles_occluded += context.stats.tile_triangles_occluded;
+        total.fragments += context.stats.fragments;
+        total.shaded += context.stats.shaded;
+        total.resolved += context.stats.resolved;
+        total.tile_lights += context.stats.tile_lights;
+        total.lit_tiles += context.stats.lit_tiles;
+    }
+    return total;
+}
+
+
+void Renderer::render_scene(Scene &scene, const Camera &camera)
+{
+    PROFILE_SCOPE("render_scene");
+    // Triangles live until the end of the frame, the ids in the visibility buffer refer to them until the resolve.
+    for (auto &context : contexts)
+    {
+        context.stats = PrimitiveStats {};
+        context.transform_ms = 0.0;
+        context.setup_ms = 0.0;
+        context.triangles.clear();
+        context.textured.clear();
+        context.lit.clear();
+    }
+    instances_occluded = 0;
+    timings.geometry_ms = 0.0;
+    timings.raster_ms = 0.0;
+    timings.resolve_ms = 0.0;
+
+    // Whole instances are culled against the frustum before any of their vertices are touched.
+    scene.update_bvh();
+    glm::mat4 view_projection = projection * camera.view;
+    Frustum frustum = extract_frustum(view_projection, clip_planes.near_w);
+    visible_instances.clear();
+    scene.bvh.cull(frustum, visible_instances);
+    instance_count = scene.instances.size();
+    select_lods(scene, view_projection);
+    prepare_lights(scene, camera);
+
+    // Grouped by model and level of detail for batching, then in scene order, which keeps the draw order and with it depth ties independent of the hierarchy.
+    std::sort(visible_instances.begin(), visible_instances.end(), [&](uint32_t a, uint32_t b)
+    {
+        const ModelInstance &instance_a = scene.instances[a];
+        const ModelInstance &instance_b = scene.instances[b];
+        if (instance_a.model != instance_b.model)
+            return instance_a.model < instance_b.model;
+        return instance_a.lod != instance_b.lod ? instance_a.lod < instance_b.lod : a < b;
+    });
+
+    if (!occluder_pass)
+    {
+        render_instances(scene, camera, visible_instances);
+        resolve_visibility();
+        record_counters();
+        return;
+    }
+
+    // Large instances go first and fill the depth pyramid, the others are tested against it before their vertex work.
+    float occluder_min_area = OCCLUDER_MIN_SCREEN_SHARE * static_cast<float>(WIDTH) * static_cast<float>(HEIGHT);
+    pass_instances.clear();
+    occludees.clear();
+    for (uint32_t index : visible_instances)
+    {
+        InstanceBounds bounds { index, Rect {}, 0.0f };
+        if (!project_bounds(scene.instances[index].world_bounds, view_projection, bounds.rect, bounds.nearest_depth))
+        {
+            pass_instances.push_back(index);
+            continue;
+        }
+
+        float area = static_cast<float>(bounds.rect.max_x - bounds.rect.min_x + 1) * static_cast<float>(bounds.rect.max_y - bounds.rect.min_y + 1);
+        if (area >= occluder_min_area)
+            pass_instances.push_back(index);
+        else
+            occludees.push_back(bounds);
+    }
+    render_instances(scene, camera, pass_instances);
+
+    pass_instances.clear();
+    for (const InstanceBounds &bounds : occludees)
+    {
+        const Rect &rect = bounds.rect;
+        if (rect.min_x > rect.max_x || rect.min_y > rect.max_y || depth_pyramid.is_occluded(rect.min_x, rect.min_y, rect.max_x, rect.max_y, bounds.nearest_depth))
+            instances_occluded++;
+        else
+            pass_instances.push_back(bounds.index);
+    }
+    render_instances(scene, camera, pass_instances);
+    resolve_visibility();
+    record_counters();
+}
+
+
+void Renderer::record_counters() const
+{
+    Profiler &profiler = Profiler::get();
+    if (!profiler.is_enabled())
+        return;
+
+    PrimitiveStats stats = get_primitive_stats();
+    profiler.record_counter("instances_drawn", static_cast<int64_t>(stats.instances - stats.instances_culled - stats.instances_occluded));
+    profiler.record_counter("instances_reduced_lod", static_cast<int64_t>(stats.instances_reduced_lod));
+    profiler.record_counter("meshlets_culled", static_cast<int64_t>(stats.meshlets_frustum_culled + stats.meshlets_backface_culled));
+    profiler.record_counter("triangles_submitted", static_cast<int64_t>(stats.submitted));
+    profiler.record_counter("triangles_culled", static_cast<int64_t>(stats.frustum_culled + stats.backface_culled + stats.tile_triangles_occluded));
+    profiler.record_counter("pixels_shaded", static_cast<int64_t>(stats.shaded));
+    profiler.record_counter("pixels_resolved", static_cast<int64_t>(stats.resolved));
+    profiler.record_counter("depth_test_rejects", static_cast<int64_t>(stats.fragments - stats.shaded));
+}
+
+
+// Finest level of model with at most budget triangles, the coarsest one if none fits.
+static uint32_t find_lod(const Model &model, float budget)
+{
+    uint32_t level = 0;
+    while (level + 1 < model.get_lod_count() && static_cast<float>(model.get_lod(level).get_triangle_count()) > budget)
+    {
+        level++;
+    }
+    return level;
+}
+
+
+void Renderer::select_lods(Scene &scene, const glm::mat4 &view_projection)
+{
+    instances_reduced_lod = 0;
+    float pixel_scale = std::max(std::abs(projection[0][0] * screen_mapping.scale_x), std::abs(projection[1][1] * screen_mapping.scale_y));
+
+    for (uint32_t index : visible_instances)
+    {
+        ModelInstance &instance = scene.instances[index];
+        const Model &model = scene.models.get(instance.model);
+        const BoundingSphere &sphere = instance.world_sphere;
+        float w = (view_projection * glm::vec4(sphere.center, 1.0f)).w;
+
+        // Spheres reaching the near plane have no meaningful projected size and are close anyway.
+        if (!lod_selection || model.lods.empty() || w - sphere.radius <= clip_planes.near_w)
+        {
+            instance.lod = 0;
+            continue;
+        }
+
+        float radius = sphere.radius * pixel_scale / w;
+        float area = 3.14159265f * radius * radius;
+        float budget = area / LOD_PIXELS_PER_TRIANGLE;
+        float margin = lod_hysteresis ? LOD_HYSTERESIS : 1.0f;
+        uint32_t finest = find_lod(model, budget * margin);
+        uint32_t coarsest = find_lod(model, budget / margin);
+        instance.lod = std::min(std::max(instance.lod, finest), coarsest);
+        if (instance.lod > 0)
+            instances_reduced_lod++;
+    }
+}
+
+
+void Renderer::prepare_lights(const Scene &scene, const Camera &camera)
+{
+    view_lights.clear();
+    light_bounds.clear();
+    lighting = !scene.lights.empty();
+    ambient_light = scene.ambient_light;
+
+    Rect screen { 0, 0, WIDTH - 1, HEIGHT - 1 };
+    for (const PointLight &light : scene.lights)
+    {
+        glm::vec3 center = glm::vec3(camera.view * glm::vec4(light.position, 1.0f));
+        float radius = light.radius;
+        if (radius <= 0.0f || center.z + radius <= clip_planes.near_w)
+            continue;
+
+        float near_z = std::max(center.z - radius, clip_planes.near_w);
+        float far_z = center.z + radius;
+        LightBounds bounds { screen, 1.0f / far_z, 1.0f / near_z };
+
+        // Spheres reaching past the near plane cover the whole screen, the others the projection of their box.
+        if (center.z - radius > clip_planes.near_w)
+        {
+            float min_x = std::numeric_limits<float>::max();
+            float max_x = -std::numeric_limits<float>::max();
+            float min_y = std::numeric_limits<float>::max();
+            float max_y = -std::numeric_limits<float>::max();
+            for (float z : {near_z, far_z})
+            {
+                for (float offset : {-radius, radius})
+                {
+                    float x = (center.x + offset) * projection[0][0] / z * screen_mapping.scale_x + screen_mapping.offset_x;
+                    float y = (center.y + offset) * projection[1][1] / z * screen_mapping.scale_y + screen_mapping.offset_y;
+                    min_x = std::min(min_x, x);
+                    max_x = std::max(max_x, x);
+                    min_y = std::min(min_y, y);
+                    max_y = std::max(max_y, y);
+                }
+            }
+            if (max_x < 0.0f || max_y < 0.0f || min_x > static_cast<float>(WIDTH) || min_y > static_cast<float>(HEIGHT))
+                continue;
+
+            bounds.rect.min_x = std::max(0, static_cast<int32_t>(std::floor(min_x)) - 1);
+            bounds.rect.min_y = std::max(0, static_cast<int32_t>(std::floor(min_y)) - 1);
+            bounds.rect.max_x = std::min(WIDTH - 1, static_cast<int32_t>(std::ceil(max_x)));
+            bounds.rect.max_y = std::min(HEIGHT - 1, static_cast<int32_t>(std::ceil(max_y)));
+        }
+
+        view_lights.push_back(ViewLight { center, radius * radius, light.color, 1.0f / (radius * radius) });
+        light_bounds.push_back(bounds);
+    }
+}
+
+
+Renderer::Rect Renderer::light_tile_rect(const Rect &rect, int32_t light_tile) const
+{
+    int32_t min_x = rect.min_x + (light_tile % LIGHT_TILES_X) * LIGHT_TILE_SIZE;
+    int32_t min_y = rect.min_y + (light_tile / LIGHT_TILES_X) * LIGHT_TILE_SIZE;
+    return Rect { min_x, min_y, std::min(min_x + LIGHT_TILE_SIZE - 1, rect.max_x), std::min(min_y + LIGHT_TILE_SIZE - 1, rect.max_y) };
+}
+
+
+bool Renderer::light_reaches(const LightBounds &bounds, const Rect &rect, float min_inv_w, float max_inv_w)
+{
+    return bounds.rect.max_x >= rect.min_x && bounds.rect.min_x <= rect.max_x && bounds.rect.max_y >= rect.min_y && bounds.rect.min_y <= rect.max_y
+        && bounds.max_inv_w >= min_inv_w && bounds.min_inv_w <= max_inv_w;
+}
+
+
+void Renderer::build_tile_lights(const Rect &rect, const float *min_inv_w, const float *max_inv_w, ThreadContext &context) const
+{
+    // The scene's lights are tested against the tile once, its light tiles only test those that passed.
+    float tile_min_inv_w = std::numeric_limits<float>::max();
+    float tile_max_inv_w = -std::numeric_limits<float>::max();
+    for (int32_t i = 0; i < LIGHT_TILE_COUNT; i++)
+    {
+        if (min_inv_w[i] > max_inv_w[i])
+            continue;
+        tile_min_inv_w = std::min(tile_min_inv_w, min_inv_w[i]);
+        tile_max_inv_w = std::max(tile_max_inv_w, max_inv_w[i]);
+    }
+
+    context.candidate_lights.clear();
+    for (uint32_t light = 0; light < view_lights.size(); light++)
+    {
+        if (light_reaches(light_bounds[light], rect, tile_min_inv_w, tile_max_inv_w))
+            context.candidate_lights.push_back(light);
+    }
+
+    context.tile_lights.clear();
+    for (int32_t i = 0; i < LIGHT_TILE_COUNT; i++)
+    {
+        context.light_tile_offsets[i] = static_cast<uint32_t>(context.tile_lights.size());
+        Rect light_rect = light_tile_rect(rect, i);
+        if (min_inv_w[i] > max_inv_w[i] || light_rect.min_x > light_rect.max_x || light_rect.min_y > light_rect.max_y)
+            continue;
+
+        for (uint32_t light : context.candidate_lights)
+        {
+            if (light_reaches(light_bounds[light], light_rect, min_inv_w[i], max_inv_w[i]))
+                context.tile_lights.push_back(view_lights[light]);
+        }
+        context.stats.lit_tiles++;
+        context.stats.tile_lights += context.tile_lights.size() - context.light_tile_offsets[i];
+    }
+    context.light_tile_offsets[LIGHT_TILE_COUNT] = static_cast<uint32_t>(context.tile_lights.size());
+}
+
+
+LitShader Renderer::with_lights(const LitShader &shader, const ThreadContext &context, int32_t light_tile)
+{
+    LitShader result = shader;
+    result.lights = context.tile_lights.data() + context.light_tile_offsets[light_tile];
+    result.light_count = context.light_tile_offsets[light_tile + 1] - context.light_tile_offsets[light_tile];
+    return result;
+}
+
+
+void Renderer::render_instances(Scene &scene, const Camera &camera, const std::vector<uint32_t> &instances)
+{
+    if (instances.empty())
+        return;
+
+    for (auto &context : contexts)
+    {
+        for (auto &bin : context.bins)
+        {
+            bin.clear();
+        }
+        for (auto &runs : context.bin_runs)
+        {
+            runs.clear();
+        }
+    }
+
+    // Runs of instances that share a model and level of detail, capped so that one large run still spreads over all threads.
+    batches.clear();
+    bool any_cached = false;
+    for (uint32_t first = 0; first < instances.size();)
+    {
+        const ModelInstance &instance = scene.instances[instances[first]];
+        const Mesh &mesh = scene.models.get(instance.model).get_lod(instance.lod);
+        uint32_t meshlet_count = static_cast<uint32_t>(mesh.meshlets.size());
+        any_cached = any_cached || mesh.positions.size() >= VERTEX_CACHE_MIN_VERTICES;
+
+        if (meshlet_count > MAX_BATCH_MESHLETS)
+        {
+            for (uint32_t meshlet = 0; meshlet < meshlet_count; meshlet += MAX_BATCH_MESHLETS)
+            {
+                batches.push_back(InstanceBatch { first, 1, meshlet, std::min(MAX_BATCH_MESHLETS, meshlet_count - meshlet) });
+            }
+            first++;
+            continue;
+        }
+
+        uint32_t last = first + 1;
+        while (last < instances.size() && last - first < MAX_BATCH_SIZE && scene.instances[instances[last]].model == instance.model && scene.instances[instances[last]].lod == instance.lod)
+        {
+            last++;
+        }
+        batches.push_back(InstanceBatch { first, last - first, 0, meshlet_count });
+        first = last;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Cached vertices are brought up to date first, the batches of a split instance all read them.
+    if (any_cached)
+    {
+        thread_pool.parallel_for(static_cast<uint32_t>(batches.size()), [&](uint32_t index, uint32_t thread)
+        {
+            const InstanceBatch &batch = batches[index];
+            if (batch.meshlet_first != 0)
+                return;
+
+            // Instances of a batch share their mesh. Small ones are transformed and timed in render_batch.
+            const ModelInstance &first = scene.instances[instances[batch.first]];
+            const Mesh &mesh = scene.models.get(first.model).get_lod(first.lod);
+            if (mesh.positions.size() < VERTEX_CACHE_MIN_VERTICES)
+                return;
+
+            auto transform_start = std::chrono::steady_clock::now();
+            for (uint32_t i = batch.first; i < batch.first + batch.count; i++)
+            {
+                ModelInstance &instance = scene.instances[instances[i]];
+                if (!instance.vertex_cache)
+                    instance.vertex_cache = std::make_unique<VertexCache>();
+                update_vertex_cache(instance, mesh, camera, projection * camera.view);
+            }
+            contexts[thread].transform_ms += elapsed_ms(transform_start);
+        });
+    }
+
+    thread_pool.parallel_for(static_cast<uint32_t>(batches.size()), [&](uint32_t index, uint32_t thread)
+    {
+        contexts[thread].batch = index;
+        render_batch(scene, camera, batches[index], instances.data() + batches[index].first, contexts[thread]);
+    });
+    timings.geometry_ms += elapsed_ms(start);
+
+    for (const auto &context : contexts)
+    {
+        if (visibility_buffer && (static_cast<uint64_t>(context.triangles.size()) << context_bits) >= NO_TRIANGLE)
+            throw std::runtime_error("Too many triangles for the visibility buffer ids.");
+    }
+
+    start = std::chrono::steady_clock::now();
+    thread_pool.parallel_for(static_cast<uint32_t>(tiles_x * tiles_y), [&](uint32_t tile, uint32_t thread)
+    {
+        render_tile(tile, contexts[thread]);
+    });
+    timings.raster_ms += elapsed_ms(start);
+}
+
+
+// Screen rect and closest depth of a world space box, false if the box reaches the near plane.
+bool Renderer::project_bounds(const Aabb &bounds, const glm::mat4 &view_projection, Rect &rect, float &nearest_depth) const
+{
+    glm::vec2 screen_min(std::numeric_limits<float>::max());
+    glm::vec2 screen_max(-std::numeric_limits<float>::max());
+    float min_w = std::numeric_limits<float>::max();
+
+    for (int32_t corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point((corner & 1) ? bounds.max.x : bounds.min.x, (corner & 2) ? bounds.max.y : bounds.min.y, (corner & 4) ? bounds.max.z : bounds.min.z);
+        glm::vec4 clip = view_projection * glm::vec4(point, 1.0f);
+        if (clip.w < clip_planes.near_w)
+            return false;
+
+        glm::vec2 screen(clip.x / clip.w * screen_mapping.scale_x + screen_mapping.offset_x, clip.y / clip.w * screen_mapping.scale_y + screen_mapping.offset_y);
+        screen_min = glm::min(screen_min, screen);
+        screen_max = glm::max(screen_max, screen);
+        min_w = std::min(min_w, clip.w);
+    }
+
+    // Pixel centers are at +0.5, rounding outwards keeps the rect conservative.
+    rect.min_x = std::max(0, static_cast<int32_t>(std::floor(screen_min.x)) - 1);
+    rect.min_y = std::max(0, static_cast<int32_t>(std::floor(screen_min.y)) - 1);
+    rect.max_x = std::min(WIDTH - 1, static_cast<int32_t>(std::ceil(screen_max.x)));
+    rect.max_y = std::min(HEIGHT - 1, static_cast<int32_t>(std::ceil(screen_max.y)));
+    nearest_depth = encode_depth_units(DEPTH_FORMAT, (1.0f / min_w) * (1.0f + DEPTH_MARGIN));
+    return true;
+}
+
+
+// True if no triangle of meshlet faces a viewer at the object space position viewer.
+static bool is_meshlet_backfacing(const Meshlet &meshlet, const glm::vec3 &viewer)
+{
+    glm::vec3 offset = meshlet.sphere.center - viewer;
+    return glm::dot(offset, meshlet.cone_axis) >= meshlet.cone_cutoff * glm::length(offset) + meshlet.sphere.radius;
+}
+
+
+void Renderer::render_batch(Scene &scene, const Camera &camera, const InstanceBatch &batch, const uint32_t *instances, ThreadContext &context)
+{
+    PROFILE_SCOPE("render_batch");
+    const ModelInstance &first = scene.instances[instances[0]];
+    const Mesh &mesh = scene.models.get(first.model).get_lod(first.lod);
+    bool cached = mesh.positions.size() >= VERTEX_CACHE_MIN_VERTICES;
+    glm::mat4 view_projection = projection * camera.view;
+
+    // Small meshes are transformed per visible meshlet into per-thread scratch, that is cheaper than keeping them per instance.
+    // Setup is the batch time minus those transforms, which saves timing every meshlet twice.
+    auto start = std::chrono::steady_clock::now();
+    double transform_ms = 0.0;
+    // A lone meshlet is the whole mesh, which was already tested against the frustum as an instance.
+    bool cull_meshlets = mesh.meshlets.size() > 1;
+
+    // Texture of each material, none for meshes without uvs.
+    std::vector<const Texture *> &textures = context.material_textures;
+    textures.assign(mesh.materials.size(), nullptr);
+    bool textured = false;
+    for (size_t i = 0; i < mesh.materials.size() && !mesh.uvs.empty(); i++)
+    {
+        if (mesh.materials[i].texture != NO_TEXTURE)
+        {
+            textures[i] = &scene.textures[mesh.materials[i].texture];
+            textured = true;
+        }
+    }
+    bool normals = lighting && !mesh.normals.empty();
+    for (uint32_t i = 0; i < batch.count; i++)
+    {
+        const ModelInstance &instance = scene.instances[instances[i]];
+        glm::mat4 mvp = view_projection * instance.transform.model;
+
+        VertexAttributes attributes { mesh.uvs.data(), normals ? mesh.normals.data() : nullptr, glm::mat3(1.0f) };
+        if (normals)
+            attributes.normal_matrix = glm::transpose(glm::inverse(glm::mat3(camera.view * instance.transform.model)));
+
+        // Meshlets are tested in object space, against the frustum planes and the viewer brought there.
+        Frustum frustum;
+        glm::vec3 viewer(0.0f);
+        bool cone_culling = false;
+        if (cull_meshlets)
+        {
+            frustum = extract_frustum(mvp, clip_planes.near_w);
+            normalize_frustum(frustum);
+            glm::mat4 model_view = camera.view * instance.transform.model;
+            viewer = glm::vec3(glm::inverse(model_view)[3]);
+            // A mirroring transform flips the winding on screen, the cones would then pick the front faces.
+            cone_culling = backface_culling && glm::dot(glm::cross(glm::vec3(model_view[0]), glm::vec3(model_view[1])), glm::vec3(model_view[2])) > 0.0f;
+        }
+
+        for (uint32_t m = batch.meshlet_first; m < batch.meshlet_first + batch.meshlet_count; m++)
+        {
+            const Meshlet &meshlet = mesh.meshlets[m];
+            context.stats.meshlets++;
+            if (cull_meshlets && !intersects_frustum(frustum, meshlet.sphere))
+            {
+                context.stats.meshlets_frustum_culled++;
+                continue;
+            }
+            if (cone_culling && is_meshlet_backfacing(meshlet, viewer))
+            {
+                context.stats.meshlets_backface_culled++;
+                continue;
+            }
+
+            const uint16_t *material_ids = mesh.material_ids.data() + meshlet.triangle_offset;
+            if (cached)
+            {
+                const uint32_t *indices = mesh.indices.data() + meshlet.triangle_offset * 3;
+                for (uint32_t j = 0; j < meshlet.triangle_count; j++)
+                {
+                    uint16_t material = material_ids[j];
+                    render_triangle(indices + j * 3, mesh.materials[material].color, textures[material], attributes, instance.vertex_cache->vertices, context);
+                }
+                continue;
+            }
+
+            auto transform_start = std::chrono::steady_clock::now();
+            glm::vec3 positions[MESHLET_MAX_VERTICES];
+            for (uint32_t v = 0; v < meshlet.vertex_count; v++)
+            {
+                positions[v] = mesh.positions[mesh.meshlet_vertices[meshlet.vertex_offset + v]];
+            }
+            transform_vertices(positions, meshlet.vertex_count, mvp, screen_mapping, clip_planes, context.meshlet_vertices);
+            transform_ms += elapsed_ms(transform_start);
+
+            glm::vec2 uvs[MESHLET_MAX_VERTICES];
+            glm::vec3 meshlet_normals[MESHLET_MAX_VERTICES];
+            for (uint32_t v = 0; v < meshlet.vertex_count && (textured || normals); v++)
+            {
+                uint32_t vertex = mesh.meshlet_vertices[meshlet.vertex_offset + v];
+                if (textured)
+                    uvs[v] = mesh.uvs[vertex];
+                if (normals)
+                    meshlet_normals[v] = mesh.normals[vertex];
+            }
+            VertexAttributes meshlet_attributes { uvs, normals ? meshlet_normals : nullptr, attributes.normal_matrix };
+
+            const uint8_t *indices = mesh.meshlet_triangles.data() + meshlet.triangle_offset * 3;
+            for (uint32_t j = 0; j < meshlet.triangle_count; j++)
+            {
+                uint16_t material = material_ids[j];
+                render_triangle(indices + j * 3, mesh.materials[material].color, textures[material], meshlet_attributes, context.meshlet_vertices, context);
+            }
+        }
+    }
+    context.transform_ms += transform_ms;
+    context.setup_ms += elapsed_ms(start) - transform_ms;
+}
+
+
+const TransformedVertices &Renderer::update_vertex_cache(ModelInstance &instance, const Mesh &mesh, const Camera &camera, const glm::mat4 &view_projection)
+{
+    VertexCache &cache = *instance.vertex_cache;
+
+    // Vertices only move when the camera, the instance or the projection changed since the last frame.
+    if (cache.camera_version != camera.version || cache.transform_version != instance.transform_version || cache.projection_version != projection_version || cache.lod != instance.lod || cache.vertices.size() != mesh.positions.size())
+    {
+        transform_vertices(mesh.positions.data(), mesh.positions.size(), view_projection * instance.transform.model, screen_mapping, clip_planes, cache.vertices);
+
+        cache.camera_version = camera.version;
+        cache.transform_version = instance.transform_version;
+        cache.projection_version = projection_version;
+        cache.lod = instance.lod;
+    }
+    return cache.vertices;
+}
+
+
+template <typename Index>
+void Renderer::render_triangle(const Index *indices, const sf::Color &color, const Texture *texture, const VertexAttributes &attributes, const TransformedVertices &vertices, ThreadContext &context)
+{
+    uint32_t i[3] = { indices[0], indices[1], indices[2] };
+
+    context.stats.submitted++;
+
+    uint16_t code0 = vertices.clip_codes[i[0]];
+    uint16_t code1 = vertices.clip_codes[i[1]];
+    uint16_t code2 = vertices.clip_codes[i[2]];
+
+    // All three vertices outside of the same plane.
+    if (code0 & code1 & code2)
+    {
+        context.stats.frustum_culled++;
+        return;
+    }
+
+    TriangleAttributes corners;
+    for (int32_t k = 0; k < 3 && texture; k++)
+    {
+        corners.uvs[k] = attributes.uvs[i[k]];
+    }
+    if (lighting)
+    {
+        for (int32_t k = 0; k < 3; k++)
+        {
+            corners.positions[k] = clip_to_view(vertices.clip_x[i[k]], vertices.clip_y[i[k]], vertices.clip_w[i[k]]);
+        }
+
+        if (attributes.normals)
+        {
+            for (int32_t k = 0; k < 3; k++)
+            {
+                corners.normals[k] = attributes.normal_matrix * attributes.normals[i[k]];
+            }
+        }
+        else
+        {
+            // Turned towards the viewer, whatever the winding.
+            glm::vec3 normal = glm::cross(corners.positions[1] - corners.positions[0], corners.positions[2] - corners.positions[0]);
+            normal = glm::dot(normal, corners.positions[0]) > 0.0f ? -normal : normal;
+            std::fill(corners.normals, corners.normals + 3, normal);
+        }
+    }
+
+    uint16_t clip_codes = (code0 | code1 | code2) & CLIP_NEEDS_CLIPPING;
+    if (clip_codes)
+    {
+        ClipVertex triangle[3] =
+        {
+            { vertices.clip_x[i[0]], vertices.clip_y[i[0]], vertices.clip_w[i[0]], 0.0f, 0.0f },
+            { vertices.clip_x[i[1]], vertices.clip_y[i[1]], vertices.clip_w[i[1]], 1.0f, 0.0f },
+            { vertices.clip_x[i[2]], vertices.clip_y[i[2]], vertices.clip_w[i[2]], 0.0f, 1.0f }
+        };
+        render_clipped_triangle(triangle, clip_codes, color, texture, corners, context);
+        return;
+    }
+
+    glm::vec2 v0(vertices.screen_x[i[0]], vertices.screen_y[i[0]]);
+    glm::vec2 v1(vertices.screen_x[i[1]], vertices.screen_y[i[1]]);
+    glm::vec2 v2(vertices.screen_x[i[2]], vertices.screen_y[i[2]]);
+    submit_triangle(v0, v1, v2, vertices.inv_w[i[0]], vertices.inv_w[i[1]], vertices.inv_w[i[2]], color, texture, corners, context);
+}
+
+
+void Renderer::render_clipped_triangle(const ClipVertex *triangle, uint16_t clip_codes, const sf::Color &color, const Texture *texture, const TriangleAttributes &corners, ThreadContext &context)
+{
+    context.stats.clipped++;
+
+    ClipVertex polygon[MAX_CLIP_VERTICES];
+    uint32_t count = clip_triangle(triangle, clip_codes, clip_planes, polygon);
+    if (count < 3)
+        return;
+
+    glm::vec2 screen[MAX_CLIP_VERTICES];
+    float inv_w[MAX_CLIP_VERTICES];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        inv_w[i] = 1.0f / polygon[i].w;
+        screen[i] = glm::vec2(polygon[i].x * inv_w[i] * screen_mapping.scale_x + screen_mapping.offset_x, polygon[i].y * inv_w[i] * screen_mapping.scale_y + screen_mapping.offset_y);
+    }
+
+    // Clipping keeps the polygon convex and its winding, so a fan covers it.
+    for (uint32_t i = 1; i + 1 < count; i++)
+    {
+        TriangleAttributes fan;
+        uint32_t fan_vertices[3] = { 0, i, i + 1 };
+        for (int32_t k = 0; k < 3; k++)
+        {
+            const ClipVertex &vertex = polygon[fan_vertices[k]];
+            float weight0 = 1.0f - vertex.s - vertex.t;
+            if (lighting)
+            {
+                fan.positions[k] = clip_to_view(vertex.x, vertex.y, vertex.w);
+                fan.normals[k] = corners.normals[0] * weight0 + corners.normals[1] * vertex.s + corners.normals[2] * vertex.t;
+            }
+            if (texture)
+                fan.uvs[k] = corners.uvs[0] * weight0 + corners.uvs[1] * vertex.s + corners.uvs[2] * vertex.t;
+        }
+        submit_triangle(screen[0], screen[i], screen[i + 1], inv_w[0], inv_w[i], inv_w[i + 1], color, texture, fan, context);
+    }
+}
+
+
+void Renderer::submit_triangle(const glm::vec2 &v0, const glm::vec2 &v1, const glm::vec2 &v2, float d0, float d1, float d2, const sf::Color &color, const Texture *texture, const TriangleAttributes &corners, ThreadContext &context)
+{
+    TriangleSetup setup;
+    SetupResult result = setup_triangle(v0, v1, v2, d0, d1, d2, color, backface_culling, setup);
+    if (result == SetupResult::BackFacing)
+        context.stats.backface_culled++;
+    if (result != SetupResult::Accepted)
+        return;
+
+    float inv_w[3] = { d0, d1, d2 };
+    if (lighting)
+    {
+        LitVaryings varyings[3];
+        for (int32_t k = 0; k < 3; k++)
+        {
+            varyings[k] = LitVaryings { corners.positions[k], corners.normals[k], texture ? corners.uvs[k] : glm::vec2(0.0f) };
+        }
+        LitTriangle lit { {}, LitShader { glm::vec3(color.r, color.g, color.b) * (1.0f / 255.0f), texture, ambient_light } };
+        setup_varying_planes(setup.a, setup.b, setup.inv_area, setup.flipped, inv_w, varyings, lit.planes);
+        setup.shading = Shading::Lit;
+        setup.varyings = static_cast<uint32_t>(context.lit.size());
+        context.lit.push_back(lit);
+    }
+    else if (texture)
+    {
+        TextureVaryings varyings[3] = { { corners.uvs[0] }, { corners.uvs[1] }, { corners.uvs[2] } };
+        TexturedTriangle textured { {}, TextureShader { texture, color } };
+        setup_varying_planes(setup.a, setup.b, setup.inv_area, setup.flipped, inv_w, varyings, textured.planes);
+        setup.shading = Shading::Textured;
+        setup.varyings = static_cast<uint32_t>(context.textured.size());
+        context.textured.push_back(textured);
+    }
+
+    context.stats.rasterized++;
+    context.triangles.push_back(setup);
+    bin_triangle(setup, static_cast<uint32_t>(context.triangles.size() - 1), context);
+}
+
+
+void Renderer::bin_triangle(const TriangleSetup &triangle, uint32_t index, ThreadContext &context)
+{
+    int32_t tile_min_x = triangle.bounds.min_x / TILE_SIZE;
+    int32_t tile_max_x = triangle.bounds.max_x / TILE_SIZE;
+    int32_t tile_min_y = triangle.bounds.min_y / TILE_SIZE;
+    int32_t tile_max_y = triangle.bounds.max_y / TILE_SIZE;
+
+    bool single_tile = tile_min_x == tile_max_x && tile_min_y == tile_max_y;
+
+    for (int32_t tile_y = tile_min_y; tile_y <= tile_max_y; tile_y++)
+    {
+        for (int32_t tile_x = tile_min_x; tile_x <= tile_max_x; tile_x++)
+        {
+            if (!single_tile && !triangle_overlaps_tile(triangle, tile_rect(tile_x, tile_y)))
+                continue;
+
+            uint32_t tile = tile_y * tiles_x + tile_x;
+            std::vector<uint32_t> &bin = context.bins[tile];
+            std::vector<BinRun> &runs = context.bin_runs[tile];
+            if (runs.empty() || runs.back().batch != context.batch)
+                runs.push_back(BinRun { context.batch, 0, static_cast<uint32_t>(bin.size()), static_cast<uint32_t>(bin.size()) });
+            bin.push_back(index);
+            runs.back().end++;
+        }
+    }
+}
+
+
+bool Renderer::triangle_overlaps_tile(const TriangleSetup &triangle, const Rect &rect) const
+{
+    // The tile is outside if any edge function is negative at the tile corner where that edge is largest, taken at the
+    // sample of that corner pixel where it is largest.
+    for (int32_t i = 0; i < 3; i++)
+    {
+        int64_t x = triangle.a[i] > 0 ? rect.max_x : rect.min_x;
+        int64_t y = triangle.b[i] > 0 ? rect.max_y : rect.min_y;
+        int64_t lowest;
+        int64_t highest;
+        edge_sample_range(triangle, i, lowest, highest);
+        int64_t value = triangle.a[i] * (x * SUBPIXEL_STEP + SUBPIXEL_HALF) + triangle.b[i] * (y * SUBPIXEL_STEP + SUBPIXEL_HALF) + triangle.c[i] + highest;
+        if (value < 0)
+            return false;
+    }
+    return true;
+}
+
+
+Renderer::Rect Renderer::tile_rect(int32_t tile_x, int32_t tile_y) const
+{
+    return Rect { tile_x * TILE_SIZE, tile_y * TILE_SIZE, std::min((tile_x + 1) * TILE_SIZE, WIDTH) - 1, std::min((tile_y + 1) * TILE_SIZE, HEIGHT) - 1 };
+}
+
+
+void Renderer::render_tile(uint32_t tile, ThreadContext &context)
+{
+    PROFILE_SCOPE("render_tile");
+    Rect rect = tile_rect(static_cast<int32_t>(tile % tiles_x), static_cast<int32_t>(tile / tiles_x));
+
+    // Tiles no triangle reaches keep their clear pending.
+    bool touched = false;
+    for (const auto &source : contexts)
+    {
+        touched = touched || !source.bins[tile].empty();
+    }
+    if (!touched)
+        return;
+    materialize_tile(tile);
+    if (visibility_buffer)
+        visibility_tiles[tile] = 1;
+
+    // Without the final depth yet, the lights are culled against the depth range of the triangles binned here.
+    if (lighting && !visibility_buffer)
+    {
+        float min_inv_w[LIGHT_TILE_COUNT];
+        float max_inv_w[LIGHT_TILE_COUNT];
+        std::fill(min_inv_w, min_inv_w + LIGHT_TILE_COUNT, std::numeric_limits<float>::max());
+        std::fill(max_inv_w, max_inv_w + LIGHT_TILE_COUNT, -std::numeric_limits<float>::max());
+        for (const auto &source : contexts)
+        {
+            for (uint32_t index : source.bins[tile])
+            {
+                const TriangleSetup &triangle = source.triangles[index];
+                int32_t min_x = (std::max(triangle.bounds.min_x, rect.min_x) - rect.min_x) / LIGHT_TILE_SIZE;
+                int32_t min_y = (std::max(triangle.bounds.min_y, rect.min_y) - rect.min_y) / LIGHT_TILE_SIZE;
+                int32_t max_x = (std::min(triangle.bounds.max_x, rect.max_x) - rect.min_x) / LIGHT_TILE_SIZE;
+                int32_t max_y = (std::min(triangle.bounds.max_y, rect.max_y) - rect.min_y) / LIGHT_TILE_SIZE;
+                for (int32_t y = min_y; y <= max_y; y++)
+                {
+                    for (int32_t x = min_x; x <= max_x; x++)
+                    {
+                        min_inv_w[y * LIGHT_TILES_X + x] = std::min(min_inv_w[y * LIGHT_TILES_X + x], triangle.min_inv_w);
+                        max_inv_w[y * LIGHT_TILES_X + x] = std::max(max_inv_w[y * LIGHT_TILES_X + x], triangle.max_inv_w);
+                    }
+                }
+            }
+        }
+        build_tile_lights(rect, min_inv_w, max_inv_w, context);
+    }
+
+    // Every batch was set up by a single context, so its runs order the triangles of the tile completely.
+    std::vector<BinRun> &runs = context.tile_runs;
+    runs.clear();
+    for (uint32_t source_index = 0; source_index < contexts.size(); source_index++)
+    {
+        for (const BinRun &run : contexts[source_index].bin_runs[tile])
+        {
+            runs.push_back(BinRun { run.batch, source_index, run.begin, run.end });
+        }
+    }
+    std::sort(runs.begin(), runs.end(), [](const BinRun &a, const BinRun &b) { return a.batch < b.batch; });
+
+    for (const BinRun &run : runs)
+    {
+        uint32_t source_index = run.source;
+        const ThreadContext &source = contexts[source_index];
+        for (uint32_t entry = run.begin; entry < run.end; entry++)
+        {
+            uint32_t index = source.bins[tile][entry];
+            const TriangleSetup &triangle = source.triangles[index];
+            Rect covered
+            {
+                std::max(triangle.bounds.min_x, rect.min_x),
+                std::max(triangle.bounds.min_y, rect.min_y),
+                std::min(triangle.bounds.max_x, rect.max_x),
+                std::min(triangle.bounds.max_y, rect.max_y)
+            };
+
+            context.stats.tile_triangles++;
+            if (depth_pyramid.is_occluded(covered.min_x, covered.min_y, covered.max_x, covered.max_y, triangle.max_depth))
+            {
+                context.stats.tile_triangles_occluded++;
+                continue;
+            }
+
+            if (visibility_buffer)
+                rasterize_visibility(triangle, (index << context_bits) | source_index, covered, context.stats);
+            else if (triangle.shading == Shading::Flat)
+                rasterize_triangle(triangle, covered, context.stats);
+            else if (triangle.shading == Shading::Textured)
+                shade_triangle(triangle, source.textured[triangle.varyings].planes, source.textured[triangle.varyings].shader, covered, context.stats);
+            else
+            {
+                // One part per light tile, each lit by the lights of its own.
+                const LitTriangle &lit = source.lit[triangle.varyings];
+                for (int32_t y = (covered.min_y - rect.min_y) / LIGHT_TILE_SIZE; y <= (covered.max_y - rect.min_y) / LIGHT_TILE_SIZE; y++)
+                {
+                    for (int32_t x = (covered.min_x - rect.min_x) / LIGHT_TILE_SIZE; x <= (covered.max_x - rect.min_x) / LIGHT_TILE_SIZE; x++)
+                    {
+                        Rect light_rect = light_tile_rect(rect, y * LIGHT_TILES_X + x);
+                        Rect part { std::max(light_rect.min_x, covered.min_x), std::max(light_rect.min_y, covered.min_y), std::min(light_rect.max_x, covered.max_x), std::min(light_rect.max_y, covered.max_y) };
+                        shade_triangle(triangle, lit.planes, with_lights(lit.shader, context, y * LIGHT_TILES_X + x), part, context.stats);
+                    }
+                }
+            }
+            depth_pyramid.update(depth_buffer.get(), covered.min_x, covered.min_y, covered.max_x, covered.max_y);
+        }
+    }
+}
+
+
+void Renderer::resolve_visibility()
+{
+    if (!visibility_buffer)
+        return;
+
+    PROFILE_SCOPE("resolve_visibility");
+    auto start = std::chrono::steady_clock::now();
+    thread_pool.parallel_for(static_cast<uint32_t>(visibility_tiles.size()), [&](uint32_t tile, uint32_t thread)
+    {
+        if (!visibility_tiles[tile])
+            return;
+        visibility_tiles[tile] = 0;
+        resolve_tile(tile, contexts[thread]);
+    });
+    timings.resolve_ms += elapsed_ms(start);
+}
+
+
+void Renderer::resolve_tile(uint32_t tile, ThreadContext &context)
+{
+    PROFILE_SCOPE("resolve_tile");
+    Rect rect = tile_rect(static_cast<int32_t>(tile % tiles_x), static_cast<int32_t>(tile / tiles_x));
+    uint32_t context_mask = (1u << context_bits) - 1;
+    uint32_t *pixels = reinterpret_cast<uint32_t *>(color_buffer.pixels.get());
+
+    // Lights are culled against the depth range of the pixels waiting in each light tile, which the depth buffer
+    // now holds exactly.
+    if (lighting)
+    {
+        float min_inv_w[LIGHT_TILE_COUNT];
+        float max_inv_w[LIGHT_TILE_COUNT];
+        dispatch_depth_format(DEPTH_FORMAT, [&](auto format)
+        {
+            using Format = decltype(format);
+            using Storage = typename Format::Storage;
+            Storage nearest[LIGHT_TILE_COUNT];
+            Storage farthest[LIGHT_TILE_COUNT];
+            std::fill(nearest, nearest + LIGHT_TILE_COUNT, std::numeric_limits<Storage>::lowest());
+            std::fill(farthest, farthest + LIGHT_TILE_COUNT, std::numeric_limits<Storage>::max());
+            bool lit[LIGHT_TILE_COUNT] = {};
+
+            for (int32_t y = rect.min_y; y <= rect.max_y; y++)
+            {
+                size_t offset = static_cast<size_t>(y) * WIDTH;
+                const Storage *depth = static_cast<const Storage *>(depth_at(offset));
+                int32_t row = (y - rect.min_y) / LIGHT_TILE_SIZE * LIGHT_TILES_X;
+                for (int32_t x = rect.min_x; x <= rect.max_x; x++)
+                {
+                    if (visibility_buffer[offset + x] == NO_TRIANGLE)
+                        continue;
+                    int32_t light_tile = row + (x - rect.min_x) / LIGHT_TILE_SIZE;
+                    nearest[light_tile] = std::max(nearest[light_tile], depth[x]);
+                    farthest[light_tile] = std::min(farthest[light_tile], depth[x]);
+                    lit[light_tile] = true;
+                }
+            }
+
+            for (int32_t i = 0; i < LIGHT_TILE_COUNT; i++)
+            {
+                min_inv_w[i] = lit[i] ? Format::decode(farthest[i]) : 1.0f;
+                max_inv_w[i] = lit[i] ? Format::decode(nearest[i]) : 0.0f;
+            }
+        });
+        build_tile_lights(rect, min_inv_w, max_inv_w, context);
+    }
+
+    for (int32_t y = rect.min_y; y <= rect.max_y; y++)
+    {
+        uint32_t *ids = visibility_buffer.get() + static_cast<size_t>(y) * WIDTH;
+
+        // Runs of one triangle are shaded like the spans of the forward path, from one evaluation of its planes.
+        // With lights they end at the edge of their light tile.
+        for (int32_t x = rect.min_x; x <= rect.max_x;)
+        {
+            uint32_t id = ids[x];
+            int32_t light_tile = (y - rect.min_y) / LIGHT_TILE_SIZE * LIGHT_TILES_X + (x - rect.min_x) / LIGHT_TILE_SIZE;
+            int32_t last = lighting ? std::min(rect.max_x, light_tile_rect(rect, light_tile).max_x) : rect.max_x;
+            int32_t end = x + 1;
+            while (end <= last && ids[end] == id)
+            {
+                end++;
+            }
+
+            if (id != NO_TRIANGLE)
+            {
+                const ThreadContext &source = contexts[id & context_mask];
+                const TriangleSetup &triangle = source.triangles[id >> context_bits];
+                if (triangle.shading == Shading::Flat)
+                    std::fill(pixels + static_cast<size_t>(y) * WIDTH + x, pixels + static_cast<size_t>(y) * WIDTH + end, pack_color(triangle.color));
+                else if (triangle.shading == Shading::Textured)
+                    shade_visible(triangle, source.textured[triangle.varyings].planes, source.textured[triangle.varyings].shader, y, x, end);
+                else
+                    shade_visible(triangle, source.lit[triangle.varyings].planes, with_lights(source.lit[triangle.varyings].shader, context, light_tile), y, x, end);
+
+                std::fill(ids + x, ids + end, NO_TRIANGLE);
+                context.stats.resolved += static_cast<uint64_t>(end - x);
+            }
+            x = end;
+        }
+    }
+}
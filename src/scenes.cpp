@@ -0,0 +1,287 @@
+#include "scenes.hpp"
+#include "mesh_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+Scene create_cubes_scene()
+{
+    Scene scene;
+    ModelHandle model = scene.models.add(cube);
+    scene.add_instance(model, ModelTransform(glm::vec3(1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 45.0f, glm::vec3(2.0f, 0.0f, 7.0f)));
+    scene.add_instance(model, ModelTransform(glm::vec3(1.0f), glm::vec3(1.0f), 0.0f, glm::vec3(-1.25f, 0.0f, 7.0f)));
+    return scene;
+}
+
+
+Scene create_cube_field_scene(int32_t size)
+{
+    const float spacing = 6.0f;
+
+    Scene scene;
+    ModelHandle model = scene.models.add(cube);
+    scene.instances.reserve(static_cast<size_t>(size) * size);
+    for (int32_t z = 0; z < size; z++)
+    {
+        for (int32_t x = 0; x < size; x++)
+        {
+            glm::vec3 position((x - size / 2) * spacing, ((x + z) % 5 - 2) * 1.5f, (z - size / 2) * spacing);
+            float angle = static_cast<float>((x * 37 + z * 61) % 360);
+            scene.add_instance(model, ModelTransform(glm::vec3(1.0f), glm::vec3(0.0f, 1.0f, 0.0f), angle, position));
+        }
+    }
+    return scene;
+}
+
+
+Scene create_overdraw_scene(int32_t layers)
+{
+    Scene scene;
+    ModelHandle model = scene.models.add(cube);
+    for (int32_t i = layers - 1; i >= 0; i--)
+    {
+        // Width grows with distance, so each slab covers the screen.
+        float z = 4.0f + static_cast<float>(i) * 0.5f;
+        float size = (z + 1.0f) * 0.6f;
+        scene.add_instance(model, ModelTransform(glm::vec3(size, size, 0.1f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, glm::vec3(0.0f, 0.0f, z)));
+    }
+    return scene;
+}
+
+
+Scene create_tiny_triangles_scene(int32_t resolution)
+{
+    Model model;
+    model.name = "Tiny triangles";
+    // The scene exists to measure sub-pixel triangles, a simplified plane would hide them.
+    model.generate_lods = false;
+
+    Mesh &mesh = model.mesh;
+    uint32_t row = static_cast<uint32_t>(resolution) + 1;
+    mesh.positions.reserve(static_cast<size_t>(row) * row);
+    for (uint32_t y = 0; y < row; y++)
+    {
+        for (uint32_t x = 0; x < row; x++)
+        {
+            mesh.positions.emplace_back(static_cast<float>(x) / resolution * 2.0f - 1.0f, 1.0f - static_cast<float>(y) / resolution * 2.0f, 0.0f);
+        }
+    }
+
+    mesh.materials = { Material { sf::Color::White }, Material { sf::Color(128, 128, 128) } };
+    for (uint32_t y = 0; y < static_cast<uint32_t>(resolution); y++)
+    {
+        for (uint32_t x = 0; x < static_cast<uint32_t>(resolution); x++)
+        {
+            uint32_t top_left = y * row + x;
+            uint32_t bottom_left = top_left + row;
+            mesh.indices.insert(mesh.indices.end(), { top_left, top_left + 1, bottom_left + 1, top_left, bottom_left + 1, bottom_left });
+            uint16_t material = static_cast<uint16_t>((x / 8 + y / 8) % 2);
+            mesh.material_ids.insert(mesh.material_ids.end(), { material, material });
+        }
+    }
+
+    Scene scene;
+    ModelHandle handle = scene.models.add(std::move(model));
+    scene.add_instance(handle, ModelTransform(glm::vec3(1.5f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, glm::vec3(0.0f, 0.0f, 3.0f)));
+    return scene;
+}
+
+
+// The cube with four vertices of its own per face, so each face can hold the whole texture.
+static Model create_textured_cube_model()
+{
+    Model model;
+    model.name = "Textured cube";
+
+    Mesh &mesh = model.mesh;
+    const uint32_t faces[6][4] = { { 0, 1, 2, 3 }, { 4, 0, 3, 7 }, { 5, 4, 7, 6 }, { 1, 5, 6, 2 }, { 4, 5, 1, 0 }, { 2, 6, 7, 3 } };
+    const glm::vec2 corners[4] = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } };
+    for (const auto &face : faces)
+    {
+        uint32_t first = static_cast<uint32_t>(mesh.positions.size());
+        for (int32_t corner = 0; corner < 4; corner++)
+        {
+            mesh.positions.push_back(cube.mesh.positions[face[corner]]);
+            mesh.uvs.push_back(corners[corner]);
+        }
+        mesh.indices.insert(mesh.indices.end(), { first, first + 1, first + 2, first, first + 2, first + 3 });
+        mesh.material_ids.insert(mesh.material_ids.end(), { 0, 0 });
+    }
+    mesh.materials = { Material { sf::Color::White, 1 } };
+    return model;
+}
+
+
+Scene create_textured_scene(int32_t resolution)
+{
+    const float width = 100.0f;
+    const float depth = 150.0f;
+
+    Model floor;
+    floor.name = "Textured floor";
+    Mesh &mesh = floor.mesh;
+
+    // Starts behind the camera so the near plane clips it, the checker repeats every two units.
+    uint32_t row = static_cast<uint32_t>(resolution) + 1;
+    for (uint32_t z = 0; z < row; z++)
+    {
+        for (uint32_t x = 0; x < row; x++)
+        {
+            glm::vec3 position((static_cast<float>(x) / resolution - 0.5f) * width, -1.5f, static_cast<float>(z) / resolution * depth - 2.0f);
+            mesh.positions.push_back(position);
+            mesh.uvs.emplace_back(position.x * 0.5f, position.z * 0.5f);
+        }
+    }
+    for (uint32_t z = 0; z < static_cast<uint32_t>(resolution); z++)
+    {
+        for (uint32_t x = 0; x < static_cast<uint32_t>(resolution); x++)
+        {
+            uint32_t near_left = z * row + x;
+            uint32_t far_left = near_left + row;
+            mesh.indices.insert(mesh.indices.end(), { near_left, far_left, far_left + 1, near_left, far_left + 1, near_left + 1 });
+            mesh.material_ids.insert(mesh.material_ids.end(), { 0, 0 });
+        }
+    }
+    mesh.materials = { Material { sf::Color::White, 0 } };
+
+    Scene scene;
+    scene.textures.push_back(create_checker_texture(256, 2, sf::Color(230, 230, 230), sf::Color(40, 60, 120)));
+    scene.textures.push_back(create_checker_texture(64, 8, sf::Color(200, 120, 40), sf::Color(90, 50, 20)));
+
+    ModelHandle floor_handle = scene.models.add(std::move(floor));
+    scene.add_instance(floor_handle, ModelTransform());
+    ModelHandle cube_handle = scene.models.add(create_textured_cube_model());
+    for (int32_t i = 0; i < 8; i++)
+    {
+        glm::vec3 position(static_cast<float>(i % 4) * 3.0f - 4.5f, -0.5f, 6.0f + static_cast<float>(i / 4) * 6.0f);
+        scene.add_instance(cube_handle, ModelTransform(glm::vec3(1.0f), glm::vec3(0.0f, 1.0f, 0.0f), static_cast<float>(i * 25), position));
+    }
+    return scene;
+}
+
+
+Scene create_lights_scene(int32_t light_count)
+{
+    Scene scene = create_textured_scene();
+    scene.ambient_light = glm::vec3(0.03f);
+
+    // Rows of small lights just above the floor, each of them reaches a few tiles at most.
+    const int32_t columns = 16;
+    for (int32_t i = 0; i < light_count; i++)
+    {
+        int32_t column = i % columns;
+        int32_t row = i / columns;
+        glm::vec3 position(static_cast<float>(column) * 1.6f - 12.0f, -1.0f, 1.0f + static_cast<float>(row) * 2.5f);
+
+        // Hues around the color wheel, neighbors far apart.
+        float hue = static_cast<float>((i * 7) % 24) / 24.0f * 6.0f;
+        glm::vec3 color(glm::clamp(std::abs(hue - 3.0f) - 1.0f, 0.0f, 1.0f), glm::clamp(2.0f - std::abs(hue - 2.0f), 0.0f, 1.0f), glm::clamp(2.0f - std::abs(hue - 4.0f), 0.0f, 1.0f));
+        scene.lights.push_back(PointLight { position, 2.5f, color * 1.5f });
+    }
+    return scene;
+}
+
+
+// One gray material per brightness level, each face picks the level of its angle to the camera.
+static void shade_by_facing(Mesh &mesh)
+{
+    mesh.materials.resize(256);
+    for (size_t i = 0; i < mesh.materials.size(); i++)
+    {
+        uint8_t value = static_cast<uint8_t>(i);
+        mesh.materials[i] = Material { sf::Color(value, value, value) };
+    }
+
+    const glm::vec3 light_direction(0.0f, 0.0f, 1.0f);
+    for (size_t i = 0; i < mesh.get_triangle_count(); i++)
+    {
+        const glm::vec3 &v0 = mesh.positions[mesh.indices[i * 3]];
+        const glm::vec3 &v1 = mesh.positions[mesh.indices[i * 3 + 1]];
+        const glm::vec3 &v2 = mesh.positions[mesh.indices[i * 3 + 2]];
+
+        glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+        float length = glm::length(normal);
+        float brightness = length > 0.0f ? std::abs(glm::dot(normal / length, light_direction)) : 0.0f;
+
+        mesh.material_ids[i] = static_cast<uint16_t>(40.0f + 215.0f * brightness);
+    }
+}
+
+
+static Model create_obj_model(const std::string &path)
+{
+    Model model;
+    model.name = path;
+    model.mesh = load_obj_cached(path, model.lods);
+
+    // Levels of detail are shaded from their own faces.
+    shade_by_facing(model.mesh);
+    for (Mesh &lod : model.lods)
+    {
+        shade_by_facing(lod);
+    }
+    return model;
+}
+
+
+Scene create_obj_scene(const std::string &path, const std::string &texture_path)
+{
+    Scene scene;
+    Model model = create_obj_model(path);
+    if (!texture_path.empty())
+    {
+        scene.textures.push_back(load_texture(texture_path));
+        for (Material &material : model.mesh.materials)
+        {
+            material.texture = 0;
+        }
+        for (Mesh &lod : model.lods)
+        {
+            for (Material &material : lod.materials)
+            {
+                material.texture = 0;
+            }
+        }
+    }
+    ModelHandle handle = scene.models.add(std::move(model));
+    scene.add_instance(handle, ModelTransform(glm::vec3(1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 180.0f, glm::vec3(0.0f, 0.0f, 3.0f)));
+    return scene;
+}
+
+
+Scene create_obj_crowd_scene(const std::string &path, int32_t size)
+{
+    const float spacing = 2.5f;
+
+    Scene scene;
+    ModelHandle handle = scene.models.add(create_obj_model(path));
+    scene.instances.reserve(static_cast<size_t>(size) * size);
+    for (int32_t z = 0; z < size; z++)
+    {
+        for (int32_t x = 0; x < size; x++)
+        {
+            glm::vec3 position((x - size / 2) * spacing, -1.0f, 3.0f + z * spacing);
+            scene.add_instance(handle, ModelTransform(glm::vec3(1.0f), glm::vec3(0.0f, 1.0f, 0.0f), 180.0f, position));
+        }
+    }
+    return scene;
+}
+
+
+Scene create_scene_by_name(const std::string &name, int32_t field_size, const std::string &texture_path)
+{
+    if (name == "cubes")
+        return create_cubes_scene();
+    if (name == "field")
+        return create_cube_field_scene(field_size);
+    if (name == "overdraw")
+        return create_overdraw_scene();
+    if (name == "tiny")
+        return create_tiny_triangles_scene();
+    if (name == "textured")
+        return create_textured_scene();
+    if (name == "lights")
+        return create_lights_scene();
+    return create_obj_scene(name, texture_path);
+}
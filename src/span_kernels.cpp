@@ -0,0 +1,98 @@
+#include "span_kernels.hpp"
+
+#include <stdexcept>
+
+#if defined(RASTERIZER_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+template <typename Format>
+static int32_t scalar_flat_span(uint32_t *pixels, void *depth_buffer, int32_t count, float depth_start, float depth_step, uint32_t color)
+{
+    auto *depth = static_cast<typename Format::Storage *>(depth_buffer);
+
+    int32_t written = 0;
+    for (int32_t i = 0; i < count; i++)
+    {
+        auto value = Format::encode(depth_start + depth_step * static_cast<float>(i));
+        if (depth[i] < value)
+        {
+            pixels[i] = color;
+            depth[i] = value;
+            written++;
+        }
+    }
+    return written;
+}
+
+
+static const SpanKernels scalar_span_kernels
+{
+    "scalar",
+    { scalar_flat_span<DepthFloat32>, scalar_flat_span<DepthUnorm24>, scalar_flat_span<DepthUnorm16> }
+};
+
+
+#ifdef RASTERIZER_X86
+static bool cpu_supports_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+
+const SpanKernels &get_span_kernels(SpanKernelIsa isa)
+{
+    switch (isa)
+    {
+    case SpanKernelIsa::Scalar:
+        return scalar_span_kernels;
+#ifdef RASTERIZER_X86
+    case SpanKernelIsa::SSE2:
+        return sse2_span_kernels;
+    case SpanKernelIsa::AVX2:
+        if (!cpu_supports_avx2())
+            throw std::runtime_error("AVX2 span kernels are not supported by this CPU");
+        return avx2_span_kernels;
+    case SpanKernelIsa::Auto:
+        return cpu_supports_avx2() ? avx2_span_kernels : sse2_span_kernels;
+#else
+    case SpanKernelIsa::Auto:
+        return scalar_span_kernels;
+#endif
+    default:
+        throw std::runtime_error("Span kernels are not available on this architecture");
+    }
+}
+
+
+SpanKernelIsa parse_span_kernel_isa(const std::string &name)
+{
+    if (name == "auto")
+        return SpanKernelIsa::Auto;
+    if (name == "scalar")
+        return SpanKernelIsa::Scalar;
+    if (name == "sse2")
+        return SpanKernelIsa::SSE2;
+    if (name == "avx2")
+        return SpanKernelIsa::AVX2;
+    throw std::runtime_error("Unknown span kernel " + name);
+}
@@ -0,0 +1,123 @@
+#include "span_kernels.hpp"
+
+#ifdef RASTERIZER_X86
+
+#include <cstring>
+#include <immintrin.h>
+
+
+// Built with AVX2 code generation enabled for this file only, reached through get_span_kernels() after a CPU check.
+
+static inline __m256i tail_mask(int32_t remaining)
+{
+    const __m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining), lanes);
+}
+
+
+// Depth of 8 pixels in the storage of each format, widened to 32-bit lanes. Loads and stores take the number of
+// lanes left in the span for formats without masked memory operations.
+template <typename Format>
+struct Avx2Depth;
+
+template <>
+struct Avx2Depth<DepthFloat32>
+{
+    static __m256i encode(__m256 value) { return _mm256_castps_si256(value); }
+    static __m256i load(const float *depth, __m256i active, int32_t) { return _mm256_castps_si256(_mm256_maskload_ps(depth, active)); }
+    static __m256i less(__m256i stored, __m256i value) { return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(stored), _mm256_castsi256_ps(value), _CMP_LT_OQ)); }
+    static void store(float *depth, __m256i pass, __m256i value, __m256i, int32_t) { _mm256_maskstore_ps(depth, pass, _mm256_castsi256_ps(value)); }
+};
+
+
+// Same steps as DepthUnorm::encode. Unorm values stay below 2^24, so signed compares are exact.
+template <typename Format>
+static inline __m256i encode_unorm(__m256 value)
+{
+    __m256 scaled = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(value, _mm256_set1_ps(Format::SCALE)), _mm256_setzero_ps()), _mm256_set1_ps(Format::MAX_VALUE));
+    return _mm256_cvttps_epi32(_mm256_add_ps(scaled, _mm256_set1_ps(0.5f)));
+}
+
+
+template <>
+struct Avx2Depth<DepthUnorm24>
+{
+    static __m256i encode(__m256 value) { return encode_unorm<DepthUnorm24>(value); }
+    static __m256i load(const uint32_t *depth, __m256i active, int32_t) { return _mm256_maskload_epi32(reinterpret_cast<const int *>(depth), active); }
+    static __m256i less(__m256i stored, __m256i value) { return _mm256_cmpgt_epi32(value, stored); }
+    static void store(uint32_t *depth, __m256i pass, __m256i value, __m256i, int32_t) { _mm256_maskstore_epi32(reinterpret_cast<int *>(depth), pass, value); }
+};
+
+
+// No 16-bit masked loads or stores: passing lanes are blended into the loaded values, and tails go through a copy.
+template <>
+struct Avx2Depth<DepthUnorm16>
+{
+    static __m256i encode(__m256 value) { return encode_unorm<DepthUnorm16>(value); }
+    static __m256i less(__m256i stored, __m256i value) { return _mm256_cmpgt_epi32(value, stored); }
+
+    static __m256i load(const uint16_t *depth, __m256i, int32_t remaining)
+    {
+        if (remaining >= 8)
+            return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(depth)));
+
+        alignas(16) uint16_t tail[8] = {};
+        std::memcpy(tail, depth, static_cast<size_t>(remaining) * sizeof(uint16_t));
+        return _mm256_cvtepu16_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(tail)));
+    }
+
+    static void store(uint16_t *depth, __m256i pass, __m256i value, __m256i old_depth, int32_t remaining)
+    {
+        __m256i blended = _mm256_blendv_epi8(old_depth, value, pass);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(blended), _mm256_extracti128_si256(blended, 1));
+        if (remaining >= 8)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(depth), packed);
+            return;
+        }
+
+        alignas(16) uint16_t tail[8];
+        _mm_store_si128(reinterpret_cast<__m128i *>(tail), packed);
+        std::memcpy(depth, tail, static_cast<size_t>(remaining) * sizeof(uint16_t));
+    }
+};
+
+
+template <typename Format>
+static int32_t avx2_flat_span(uint32_t *pixels, void *depth_buffer, int32_t count, float depth_start, float depth_step, uint32_t color)
+{
+    using Depth = Avx2Depth<Format>;
+    auto *depth = static_cast<typename Format::Storage *>(depth_buffer);
+    const __m256 lanes = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    const __m256 step = _mm256_set1_ps(depth_step);
+    const __m256 start = _mm256_set1_ps(depth_start);
+    const __m256i packed = _mm256_set1_epi32(static_cast<int32_t>(color));
+
+    int32_t written = 0;
+    for (int32_t i = 0; i < count; i += 8)
+    {
+        __m256i active = i + 8 <= count ? _mm256_set1_epi32(-1) : tail_mask(count - i);
+
+        __m256 t = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+        __m256i value = Depth::encode(_mm256_add_ps(start, _mm256_mul_ps(step, t)));
+        __m256i old_depth = Depth::load(depth + i, active, count - i);
+        __m256i pass = _mm256_and_si256(Depth::less(old_depth, value), active);
+
+        if (_mm256_testz_si256(pass, pass))
+            continue;
+        written += count_bits(static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(pass))));
+
+        Depth::store(depth + i, pass, value, old_depth, count - i);
+        _mm256_maskstore_epi32(reinterpret_cast<int *>(pixels + i), pass, packed);
+    }
+    return written;
+}
+
+
+const SpanKernels avx2_span_kernels
+{
+    "avx2",
+    { avx2_flat_span<DepthFloat32>, avx2_flat_span<DepthUnorm24>, avx2_flat_span<DepthUnorm16> }
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "span_kernels.hpp"
+
+#ifdef RASTERIZER_X86
+
+#include <emmintrin.h>
+
+
+// SSE2 has no masked stores, so passing lanes are blended into the loaded values and the 4 pixels are
+// written back whole. This is safe because a span is only ever touched by the thread that owns its tile.
+
+
+// Depth of 4 pixels in the storage of each format, widened to 32-bit lanes so that one compare and blend serves all.
+template <typename Format>
+struct Sse2Depth;
+
+template <>
+struct Sse2Depth<DepthFloat32>
+{
+    static __m128i encode(__m128 value) { return _mm_castps_si128(value); }
+    static __m128i load(const float *depth) { return _mm_castps_si128(_mm_loadu_ps(depth)); }
+    static __m128i less(__m128i stored, __m128i value) { return _mm_castps_si128(_mm_cmplt_ps(_mm_castsi128_ps(stored), _mm_castsi128_ps(value))); }
+    static void store(float *depth, __m128i value) { _mm_storeu_ps(depth, _mm_castsi128_ps(value)); }
+};
+
+
+// Same steps as DepthUnorm::encode. Unorm values stay below 2^24, so signed compares are exact.
+template <typename Format>
+static inline __m128i encode_unorm(__m128 value)
+{
+    __m128 scaled = _mm_min_ps(_mm_max_ps(_mm_mul_ps(value, _mm_set1_ps(Format::SCALE)), _mm_setzero_ps()), _mm_set1_ps(Format::MAX_VALUE));
+    return _mm_cvttps_epi32(_mm_add_ps(scaled, _mm_set1_ps(0.5f)));
+}
+
+
+template <>
+struct Sse2Depth<DepthUnorm24>
+{
+    static __m128i encode(__m128 value) { return encode_unorm<DepthUnorm24>(value); }
+    static __m128i load(const uint32_t *depth) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(depth)); }
+    static __m128i less(__m128i stored, __m128i value) { return _mm_cmplt_epi32(stored, value); }
+    static void store(uint32_t *depth, __m128i value) { _mm_storeu_si128(reinterpret_cast<__m128i *>(depth), value); }
+};
+
+
+template <>
+struct Sse2Depth<DepthUnorm16>
+{
+    static __m128i encode(__m128 value) { return encode_unorm<DepthUnorm16>(value); }
+    static __m128i load(const uint16_t *depth) { return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(depth)), _mm_setzero_si128()); }
+    static __m128i less(__m128i stored, __m128i value) { return _mm_cmplt_epi32(stored, value); }
+
+    static void store(uint16_t *depth, __m128i value)
+    {
+        // The only 32 to 16 bit pack saturates signed, so values are shifted into its range and the sign bit flipped back.
+        __m128i biased = _mm_sub_epi32(value, _mm_set1_epi32(0x8000));
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(biased, biased), _mm_set1_epi16(static_cast<int16_t>(0x8000)));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(depth), packed);
+    }
+};
+
+
+template <typename Format>
+static int32_t sse2_flat_span(uint32_t *pixels, void *depth_buffer, int32_t count, float depth_start, float depth_step, uint32_t color)
+{
+    using Depth = Sse2Depth<Format>;
+    auto *depth = static_cast<typename Format::Storage *>(depth_buffer);
+    const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    const __m128 step = _mm_set1_ps(depth_step);
+    const __m128 start = _mm_set1_ps(depth_start);
+    const __m128i packed = _mm_set1_epi32(static_cast<int32_t>(color));
+
+    int32_t written = 0;
+    int32_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 t = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+        __m128i value = Depth::encode(_mm_add_ps(start, _mm_mul_ps(step, t)));
+        __m128i old_depth = Depth::load(depth + i);
+        __m128i pass = Depth::less(old_depth, value);
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(pass));
+        if (mask == 0)
+            continue;
+        written += count_bits(static_cast<uint32_t>(mask));
+
+        __m128i old_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+        __m128i new_pixels = _mm_or_si128(_mm_and_si128(pass, packed), _mm_andnot_si128(pass, old_pixels));
+        __m128i new_depth = _mm_or_si128(_mm_and_si128(pass, value), _mm_andnot_si128(pass, old_depth));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + i), new_pixels);
+        Depth::store(depth + i, new_depth);
+    }
+
+    for (; i < count; i++)
+    {
+        auto value = Format::encode(depth_start + depth_step * static_cast<float>(i));
+        if (depth[i] < value)
+        {
+            pixels[i] = color;
+            depth[i] = value;
+            written++;
+        }
+    }
+    return written;
+}
+
+
+const SpanKernels sse2_span_kernels
+{
+    "sse2",
+    { sse2_flat_span<DepthFloat32>, sse2_flat_span<DepthUnorm24>, sse2_flat_span<DepthUnorm16> }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "texture.hpp"
+
+#include <stdexcept>
+
+
+static int32_t next_power_of_two(int32_t value)
+{
+    int32_t result = 1;
+    while (result < value)
+    {
+        result *= 2;
+    }
+    return result;
+}
+
+
+// Bilinear resample with the edges clamped.
+static std::vector<uint32_t> scale_image(int32_t width, int32_t height, const uint8_t *pixels, int32_t new_width, int32_t new_height)
+{
+    std::vector<uint32_t> result(static_cast<size_t>(new_width) * new_height);
+    for (int32_t y = 0; y < new_height; y++)
+    {
+        float source_y = std::max((static_cast<float>(y) + 0.5f) * height / new_height - 0.5f, 0.0f);
+        int32_t y0 = std::min(static_cast<int32_t>(source_y), height - 1);
+        int32_t y1 = std::min(y0 + 1, height - 1);
+        float fy = source_y - static_cast<float>(y0);
+
+        for (int32_t x = 0; x < new_width; x++)
+        {
+            float source_x = std::max((static_cast<float>(x) + 0.5f) * width / new_width - 0.5f, 0.0f);
+            int32_t x0 = std::min(static_cast<int32_t>(source_x), width - 1);
+            int32_t x1 = std::min(x0 + 1, width - 1);
+            float fx = source_x - static_cast<float>(x0);
+
+            uint32_t texel = 0;
+            for (int32_t channel = 0; channel < 4; channel++)
+            {
+                auto at = [&](int32_t sx, int32_t sy) { return static_cast<float>(pixels[(static_cast<size_t>(sy) * width + sx) * 4 + channel]); };
+                float top = at(x0, y0) + (at(x1, y0) - at(x0, y0)) * fx;
+                float bottom = at(x0, y1) + (at(x1, y1) - at(x0, y1)) * fx;
+                texel |= static_cast<uint32_t>(top + (bottom - top) * fy + 0.5f) << (channel * 8);
+            }
+            result[static_cast<size_t>(y) * new_width + x] = texel;
+        }
+    }
+    return result;
+}
+
+
+Texture::Texture(int32_t width, int32_t height, const uint8_t *pixels)
+{
+    if (width <= 0 || height <= 0)
+        throw std::runtime_error("Texture size must be positive");
+
+    std::vector<uint32_t> scaled;
+    if (next_power_of_two(width) != width || next_power_of_two(height) != height)
+    {
+        scaled = scale_image(width, height, pixels, next_power_of_two(width), next_power_of_two(height));
+        width = next_power_of_two(width);
+        height = next_power_of_two(height);
+        pixels = reinterpret_cast<const uint8_t *>(scaled.data());
+    }
+
+    size_t block_count = 0;
+    int32_t level_width = width;
+    int32_t level_height = height;
+    while (true)
+    {
+        int32_t blocks_x = (level_width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        int32_t blocks_y = (level_height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        levels.push_back(Level { level_width, level_height, blocks_x, block_count });
+        block_count += static_cast<size_t>(blocks_x) * blocks_y;
+
+        if (level_width == 1 && level_height == 1)
+            break;
+        level_width = std::max(level_width / 2, 1);
+        level_height = std::max(level_height / 2, 1);
+    }
+    blocks.resize(block_count);
+
+    auto set_texel = [&](const Level &level, int32_t x, int32_t y, uint32_t texel)
+    {
+        blocks[block_of(level, x, y)].texels[morton_of(x, y)] = texel;
+    };
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            uint32_t texel;
+            std::memcpy(&texel, pixels + (static_cast<size_t>(y) * width + x) * 4, sizeof(texel));
+            set_texel(levels[0], x, y, texel);
+        }
+    }
+
+    // Box filter over the 2x2 texels below each texel. Once one side is down to 1 the other keeps halving alone.
+    for (size_t i = 1; i < levels.size(); i++)
+    {
+        const Level &source = levels[i - 1];
+        const Level &level = levels[i];
+        for (int32_t y = 0; y < level.height; y++)
+        {
+            for (int32_t x = 0; x < level.width; x++)
+            {
+                int32_t x0 = std::min(x * 2, source.width - 1);
+                int32_t y0 = std::min(y * 2, source.height - 1);
+                int32_t x1 = std::min(x * 2 + 1, source.width - 1);
+                int32_t y1 = std::min(y * 2 + 1, source.height - 1);
+                uint32_t texels[4] = { texel_at(source, x0, y0), texel_at(source, x1, y0), texel_at(source, x0, y1), texel_at(source, x1, y1) };
+
+                uint32_t texel = 0;
+                for (int32_t shift = 0; shift < 32; shift += 8)
+                {
+                    uint32_t sum = 2;
+                    for (uint32_t value : texels)
+                    {
+                        sum += (value >> shift) & 0xff;
+                    }
+                    texel |= (sum / 4) << shift;
+                }
+                set_texel(level, x, y, texel);
+            }
+        }
+    }
+}
+
+
+Texture load_texture(const std::string &path)
+{
+    sf::Image image;
+    if (!image.loadFromFile(path))
+        throw std::runtime_error("Can't read texture " + path);
+
+    sf::Vector2u size = image.getSize();
+    return Texture(static_cast<int32_t>(size.x), static_cast<int32_t>(size.y), image.getPixelsPtr());
+}
+
+
+Texture create_checker_texture(int32_t size, int32_t cells, const sf::Color &color0, const sf::Color &color1)
+{
+    std::vector<uint32_t> pixels(static_cast<size_t>(size) * size);
+    int32_t cell_size = std::max(size / cells, 1);
+    for (int32_t y = 0; y < size; y++)
+    {
+        for (int32_t x = 0; x < size; x++)
+        {
+            pixels[static_cast<size_t>(y) * size + x] = pack_color((x / cell_size + y / cell_size) % 2 == 0 ? color0 : color1);
+        }
+    }
+    return Texture(size, size, reinterpret_cast<const uint8_t *>(pixels.data()));
+}
@@ -0,0 +1,137 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(uint32_t _thread_count) : thread_count(_thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    ranges = std::make_unique<WorkRange[]>(thread_count);
+
+    workers.reserve(thread_count - 1);
+    for (uint32_t thread = 1; thread < thread_count; thread++)
+    {
+        workers.emplace_back(&ThreadPool::worker_loop, this, thread);
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_condition.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+
+void ThreadPool::parallel_for(uint32_t count, const std::function<void(uint32_t, uint32_t)> &task)
+{
+    if (count == 0)
+        return;
+
+    if (thread_count == 1 || count == 1)
+    {
+        // Exceptions propagate directly.
+        for (uint32_t i = 0; i < count; i++)
+        {
+            task(i, 0);
+        }
+        return;
+    }
+
+    for (uint32_t thread = 0; thread < thread_count; thread++)
+    {
+        uint64_t begin = static_cast<uint64_t>(count) * thread / thread_count;
+        uint64_t end = static_cast<uint64_t>(count) * (thread + 1) / thread_count;
+        ranges[thread].next.store(static_cast<uint32_t>(begin), std::memory_order_relaxed);
+        ranges[thread].end = static_cast<uint32_t>(end);
+    }
+
+    failed.store(false, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_task = &task;
+        busy_workers = thread_count - 1;
+        generation++;
+    }
+    start_condition.notify_all();
+
+    run_ranges(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_condition.wait(lock, [this] { return busy_workers == 0; });
+    current_task = nullptr;
+
+    if (error)
+    {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+
+void ThreadPool::worker_loop(uint32_t thread)
+{
+    uint64_t seen_generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&] { return stopping || generation != seen_generation; });
+            if (stopping)
+                return;
+            seen_generation = generation;
+        }
+
+        run_ranges(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy_workers--;
+            if (busy_workers == 0)
+                done_condition.notify_one();
+        }
+    }
+}
+
+
+void ThreadPool::run_ranges(uint32_t thread)
+{
+    const auto &task = *current_task;
+
+    for (uint32_t offset = 0; offset < thread_count; offset++)
+    {
+        WorkRange &range = ranges[(thread + offset) % thread_count];
+        while (true)
+        {
+            uint32_t index = range.next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= range.end)
+                break;
+            if (failed.load(std::memory_order_relaxed))
+                continue;
+
+            try
+            {
+                task(index, thread);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+}
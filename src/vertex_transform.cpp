@@ -0,0 +1,143 @@
+#include "vertex_transform.hpp"
+#include "span_kernels.hpp"
+
+#include <algorithm>
+
+#ifdef RASTERIZER_X86
+#include <emmintrin.h>
+#endif
+
+
+void TransformedVertices::resize(size_t count)
+{
+    clip_x.resize(count);
+    clip_y.resize(count);
+    clip_w.resize(count);
+    screen_x.resize(count);
+    screen_y.resize(count);
+    inv_w.resize(count);
+    clip_codes.resize(count);
+}
+
+
+#ifdef RASTERIZER_X86
+
+// Four packed vec3 are three registers: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3.
+static inline void load_positions(const float *source, __m128 &x, __m128 &y, __m128 &z)
+{
+    __m128 a = _mm_loadu_ps(source);
+    __m128 b = _mm_loadu_ps(source + 4);
+    __m128 c = _mm_loadu_ps(source + 8);
+
+    x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 3, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+
+static inline __m128 transform_row(const glm::mat4 &m, int32_t row, __m128 x, __m128 y, __m128 z)
+{
+    __m128 result = _mm_mul_ps(_mm_set1_ps(m[0][row]), x);
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(m[1][row]), y));
+    result = _mm_add_ps(result, _mm_mul_ps(_mm_set1_ps(m[2][row]), z));
+    return _mm_add_ps(result, _mm_set1_ps(m[3][row]));
+}
+
+
+static inline __m128i clip_bit(__m128 outside, uint16_t bit)
+{
+    return _mm_and_si128(_mm_castps_si128(outside), _mm_set1_epi32(bit));
+}
+
+
+static void transform_batch(const float *source, const glm::mat4 &mvp, const ScreenMapping &mapping, const ClipPlanes &planes, TransformedVertices &output, size_t offset)
+{
+    __m128 x, y, z;
+    load_positions(source, x, y, z);
+
+    __m128 clip_x = transform_row(mvp, 0, x, y, z);
+    __m128 clip_y = transform_row(mvp, 1, x, y, z);
+    __m128 clip_w = transform_row(mvp, 3, x, y, z);
+    __m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), clip_w);
+
+    __m128 screen_x = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip_x, inv_w), _mm_set1_ps(mapping.scale_x)), _mm_set1_ps(mapping.offset_x));
+    __m128 screen_y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip_y, inv_w), _mm_set1_ps(mapping.scale_y)), _mm_set1_ps(mapping.offset_y));
+
+    _mm_storeu_ps(output.clip_x.data() + offset, clip_x);
+    _mm_storeu_ps(output.clip_y.data() + offset, clip_y);
+    _mm_storeu_ps(output.clip_w.data() + offset, clip_w);
+    _mm_storeu_ps(output.screen_x.data() + offset, screen_x);
+    _mm_storeu_ps(output.screen_y.data() + offset, screen_y);
+    _mm_storeu_ps(output.inv_w.data() + offset, inv_w);
+
+    // Same comparisons as compute_clip_code, so both paths classify vertices identically.
+    __m128 negative_w = _mm_sub_ps(_mm_setzero_ps(), clip_w);
+    __m128 guard_x = _mm_mul_ps(_mm_set1_ps(planes.guard_x), clip_w);
+    __m128 guard_y = _mm_mul_ps(_mm_set1_ps(planes.guard_y), clip_w);
+
+    __m128i codes = clip_bit(_mm_cmplt_ps(clip_x, negative_w), CLIP_LEFT);
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmpgt_ps(clip_x, clip_w), CLIP_RIGHT));
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmplt_ps(clip_y, negative_w), CLIP_BOTTOM));
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmpgt_ps(clip_y, clip_w), CLIP_TOP));
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmplt_ps(clip_w, _mm_set1_ps(planes.near_w)), CLIP_NEAR));
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmplt_ps(clip_x, _mm_sub_ps(_mm_setzero_ps(), guard_x)), CLIP_GUARD_LEFT));
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmpgt_ps(clip_x, guard_x), CLIP_GUARD_RIGHT));
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmplt_ps(clip_y, _mm_sub_ps(_mm_setzero_ps(), guard_y)), CLIP_GUARD_BOTTOM));
+    codes = _mm_or_si128(codes, clip_bit(_mm_cmpgt_ps(clip_y, guard_y), CLIP_GUARD_TOP));
+
+    // Codes fit in 15 bits, so the signed pack keeps them intact.
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(output.clip_codes.data() + offset), _mm_packs_epi32(codes, codes));
+}
+
+
+void transform_vertices(const glm::vec3 *positions, size_t count, const glm::mat4 &mvp, const ScreenMapping &mapping, const ClipPlanes &planes, TransformedVertices &output)
+{
+    if (count == 0)
+    {
+        output.resize(0);
+        return;
+    }
+
+    // Padded to whole batches so the tail goes through the same code as the rest.
+    size_t padded_count = (count + 3) & ~static_cast<size_t>(3);
+    output.resize(padded_count);
+
+    const float *source = &positions[0].x;
+    size_t full_count = count & ~static_cast<size_t>(3);
+    for (size_t i = 0; i < full_count; i += 4)
+    {
+        transform_batch(source + i * 3, mvp, mapping, planes, output, i);
+    }
+
+    if (full_count < count)
+    {
+        float tail[12] = {};
+        std::copy(source + full_count * 3, source + count * 3, tail);
+        transform_batch(tail, mvp, mapping, planes, output, full_count);
+    }
+
+    output.resize(count);
+}
+
+#else
+
+void transform_vertices(const glm::vec3 *positions, size_t count, const glm::mat4 &mvp, const ScreenMapping &mapping, const ClipPlanes &planes, TransformedVertices &output)
+{
+    output.resize(count);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec4 clip = mvp * glm::vec4(positions[i], 1.0f);
+        float inv_w = 1.0f / clip.w;
+
+        output.clip_x[i] = clip.x;
+        output.clip_y[i] = clip.y;
+        output.clip_w[i] = clip.w;
+        output.screen_x[i] = clip.x * inv_w * mapping.scale_x + mapping.offset_x;
+        output.screen_y[i] = clip.y * inv_w * mapping.scale_y + mapping.offset_y;
+        output.inv_w[i] = inv_w;
+        output.clip_codes[i] = compute_clip_code(clip.x, clip.y, clip.w, planes);
+    }
+}
+
+#endif